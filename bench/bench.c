@@ -0,0 +1,46 @@
+#include "bench.h"
+#include <string.h>
+#include <time.h>
+
+double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+uint32_t bench_random(uint32_t *seed)
+{
+    // xorshift32, deterministic for a given seed
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return x;
+}
+
+void bench_random_state(GameState *state, int active_count, uint32_t *seed)
+{
+    // The first active_count players active somewhere on screen
+    game_state_init(state, state->capacity);
+    for (int i = 0; i < active_count; ++i)
+    {
+        PlayerData *player = &state->player_data[i];
+        player->active = true;
+        player->x = GAME_POS(bench_random(seed) % 800);
+        player->y = GAME_POS(bench_random(seed) % 800);
+    }
+    game_state_rebuild_active(state);
+}
+
+void bench_random_events(GameEvents *events, uint32_t *seed)
+{
+    // Random held movement keys but no joins or leaves, those would log
+    game_events_clear(events);
+    for (int i = 0; i < events->capacity; ++i)
+    {
+        uint32_t keys = bench_random(seed);
+        for (int j = 0; j < 4; ++j) events->players[i].input.movements_held[j] = (keys >> j) & 1;
+    }
+}
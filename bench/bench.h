@@ -0,0 +1,23 @@
+#pragma once
+
+#include "../shared/gameimpl.h"
+#include <stdint.h>
+
+#define BENCH_CAPACITY DEFAULT_MAX_CLIENTS
+
+double bench_now(void);
+uint32_t bench_random(uint32_t *seed);
+void bench_random_state(GameState *state, int active_count, uint32_t *seed);
+void bench_random_events(GameEvents *events, uint32_t *seed);
+
+void bench_batch(void);
+void bench_capacity(void);
+void bench_collision(void);
+void bench_determinism(void);
+void bench_entities(void);
+void bench_framering(void);
+void bench_interest(void);
+void bench_kernels(void);
+void bench_pacer(void);
+void bench_parallel(void);
+void bench_soa(void);
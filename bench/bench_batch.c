@@ -0,0 +1,105 @@
+#include "../shared/gamebatch.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WORLD_UPDATES 2000000
+#define EVENT_FRAMES 8
+
+static const int world_counts[] = {16, 256, 1024};
+
+static bool states_identical(const GameState *a, const GameState *b)
+{
+    if (a->active_count != b->active_count) return false;
+    for (int i = 0; i < a->capacity; ++i)
+    {
+        const PlayerData *pa = &a->player_data[i];
+        const PlayerData *pb = &b->player_data[i];
+        if (pa->active != pb->active) return false;
+        if (!pa->active) continue;
+        if (memcmp(&pa->x, &pb->x, sizeof(game_pos_t)) != 0 || memcmp(&pa->y, &pb->y, sizeof(game_pos_t)) != 0) return false;
+    }
+    return true;
+}
+
+void bench_batch(void)
+{
+    // Many worlds of BENCH_CAPACITY players each advanced one frame at a time
+    // game_simulate() per world against one batch pass, with and without loading every worlds events
+    printf("%-8s %-14s %14s %10s %10s\n", "worlds", "path", "ns / world", "speedup", "identical");
+
+    for (size_t n = 0; n < sizeof(world_counts) / sizeof(world_counts[0]); ++n)
+    {
+        int world_count = world_counts[n];
+        int frames = WORLD_UPDATES / world_count;
+
+        uint32_t seed = 99;
+        GameState **initial = malloc(world_count * sizeof(GameState *));
+        GameState **reference = malloc(world_count * sizeof(GameState *));
+        GameState *result = game_state_alloc(BENCH_CAPACITY);
+        GameEvents **events = malloc(world_count * EVENT_FRAMES * sizeof(GameEvents *));
+        for (int w = 0; w < world_count; ++w)
+        {
+            initial[w] = game_state_alloc(BENCH_CAPACITY);
+            reference[w] = game_state_alloc(BENCH_CAPACITY);
+            bench_random_state(initial[w], BENCH_CAPACITY - 2, &seed);
+            game_state_copy(reference[w], initial[w]);
+            for (int f = 0; f < EVENT_FRAMES; ++f)
+            {
+                GameEvents *frame_events = game_events_alloc(BENCH_CAPACITY);
+                bench_random_events(frame_events, &seed);
+                if (bench_random(&seed) % 4 == 0) game_events_set(frame_events, bench_random(&seed) % BENCH_CAPACITY, PLAYER_EVENT_JOIN);
+                if (bench_random(&seed) % 4 == 0) game_events_set(frame_events, bench_random(&seed) % BENCH_CAPACITY, PLAYER_EVENT_LEAVE);
+                events[w * EVENT_FRAMES + f] = frame_events;
+            }
+        }
+
+        double start = bench_now();
+        for (int f = 0; f < frames; ++f)
+        {
+            for (int w = 0; w < world_count; ++w) game_simulate(reference[w], events[w * EVENT_FRAMES + f % EVENT_FRAMES], reference[w]);
+        }
+        double aos_ns = (bench_now() - start) * 1e9 / ((double)frames * world_count);
+        printf("%-8d %-14s %14.2f %10s %10s\n", world_count, "game_simulate", aos_ns, "1.00x", "-");
+
+        GameBatch batch;
+        if (game_batch_init(&batch, world_count, BENCH_CAPACITY) != 0) continue;
+
+        // Loading each worlds events is part of every tick, so it is timed with the kernel
+        for (int w = 0; w < world_count; ++w) game_batch_load_state(&batch, w, initial[w]);
+        start = bench_now();
+        for (int f = 0; f < frames; ++f)
+        {
+            for (int w = 0; w < world_count; ++w) game_batch_load_events(&batch, w, events[w * EVENT_FRAMES + f % EVENT_FRAMES]);
+            game_batch_simulate(&batch);
+        }
+        double batch_ns = (bench_now() - start) * 1e9 / ((double)frames * world_count);
+
+        bool identical = true;
+        for (int w = 0; w < world_count; ++w)
+        {
+            game_batch_store_state(&batch, w, result);
+            identical &= states_identical(result, reference[w]);
+        }
+        printf("%-8s %-14s %14.2f %9.2fx %10s\n", "", "batch", batch_ns, aos_ns / batch_ns, identical ? "yes" : "NO");
+
+        // The kernel alone, as when only a few worlds have new events
+        start = bench_now();
+        for (int f = 0; f < frames; ++f) game_batch_simulate(&batch);
+        double kernel_ns = (bench_now() - start) * 1e9 / ((double)frames * world_count);
+        printf("%-8s %-14s %14.2f %9.2fx %10s\n", "", "batch kernel", kernel_ns, aos_ns / kernel_ns, "-");
+
+        game_batch_free(&batch);
+        for (int w = 0; w < world_count; ++w)
+        {
+            free(initial[w]);
+            free(reference[w]);
+            for (int f = 0; f < EVENT_FRAMES; ++f) free(events[w * EVENT_FRAMES + f]);
+        }
+        free(result);
+        free(initial);
+        free(reference);
+        free(events);
+    }
+}
@@ -0,0 +1,57 @@
+#include "../shared/framering.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PLAYER_UPDATES 20000000
+
+static const int capacities[] = {16, 256, MAX_CLIENTS_LIMIT};
+static const int connected_counts[] = {16, 256, MAX_CLIENTS_LIMIT};
+static volatile uint32_t hash_sink;
+
+void bench_capacity(void)
+{
+    // Cost of advancing a ring against how many of the slots are actually connected
+    // Only the connected players should be paid for, whatever the capacity
+    // Hashing is what the server adds every STATE_HASH_INTERVAL frames and clients on confirming them
+    // Idle is the same with nobody pressing anything, which should cost next to nothing
+    printf("%-10s %10s %12s %14s %16s %11s %11s\n", "capacity", "connected", "memory (KB)", "advance (ns)", "ns / connected", "idle (ns)", "hash (ns)");
+
+    for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); ++c)
+    {
+        int capacity = capacities[c];
+        FrameRing ring;
+        if (frame_ring_init(&ring, capacity, STATE_HISTORY_MODE, STATE_CHECKPOINT_INTERVAL) != 0) continue;
+
+        GameState *state = game_state_alloc(capacity);
+        for (size_t n = 0; n < sizeof(connected_counts) / sizeof(connected_counts[0]); ++n)
+        {
+            int connected = connected_counts[n];
+            if (connected > capacity) continue;
+
+            uint32_t seed = 99;
+            bench_random_state(state, connected, &seed);
+            frame_ring_reset(&ring, 0, state);
+            for (int i = 0; i < FRAME_BUFFER_SIZE; ++i) bench_random_events(frame_ring_events(&ring, i), &seed);
+
+            int iterations = PLAYER_UPDATES / connected;
+            double start = bench_now();
+            for (int i = 0; i < iterations; ++i) frame_ring_advance(&ring);
+            double advance_ns = (bench_now() - start) * 1e9 / iterations;
+
+            for (int i = 0; i < FRAME_BUFFER_SIZE; ++i) game_events_clear(frame_ring_events(&ring, i));
+            start = bench_now();
+            for (int i = 0; i < iterations; ++i) frame_ring_advance(&ring);
+            double idle_ns = (bench_now() - start) * 1e9 / iterations;
+
+            start = bench_now();
+            for (int i = 0; i < iterations; ++i) hash_sink = game_state_hash(frame_ring_head(&ring));
+            double hash_ns = (bench_now() - start) * 1e9 / iterations;
+
+            printf("%-10d %10d %12.1f %14.1f %16.2f %11.1f %11.1f\n", capacity, connected, frame_ring_memory(&ring) / 1024.0, advance_ns, advance_ns / connected, idle_ns, hash_ns);
+        }
+
+        free(state);
+        frame_ring_free(&ring);
+    }
+}
@@ -0,0 +1,121 @@
+#include "../shared/gameimpl.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BODY_UPDATES 2000000
+#define PAIR_TESTS 200000000LL
+#define BODY_SPACING 60
+#define MAX_FRAMES 10000
+
+static const int body_counts[] = {10, 1000, 50000};
+
+#if GAME_FIXED_POINT
+typedef int64_t dist2_t;
+#else
+typedef double dist2_t;
+#endif
+
+static dist2_t dist2(game_pos_t ax, game_pos_t ay, game_pos_t bx, game_pos_t by)
+{
+    dist2_t dx = (dist2_t)ax - (dist2_t)bx;
+    dist2_t dy = (dist2_t)ay - (dist2_t)by;
+    return dx * dx + dy * dy;
+}
+
+static bool all_pairs_blocked(const GameState *before, int id, game_pos_t from_x, game_pos_t from_y, game_pos_t to_x, game_pos_t to_y)
+{
+    const dist2_t touching = (dist2_t)(2 * PLAYER_RADIUS) * (dist2_t)(2 * PLAYER_RADIUS);
+    const uint16_t *slots = game_state_active_slots(before);
+    for (int k = 0; k < before->active_count; ++k)
+    {
+        const PlayerData *other = &before->player_data[slots[k]];
+        if (slots[k] == id) continue;
+        dist2_t to_dist2 = dist2(to_x, to_y, other->x, other->y);
+        if (to_dist2 < touching && to_dist2 < dist2(from_x, from_y, other->x, other->y)) return true;
+    }
+    return false;
+}
+
+static void all_pairs_simulate(GameState *state, const GameEvents *events, GameState *before)
+{
+    // Same movement rule as game_simulate() tested against every other player, no joins or leaves
+    game_state_copy(before, state);
+    const uint16_t *slots = game_state_active_slots(state);
+    for (int k = 0; k < state->active_count; ++k)
+    {
+        int i = slots[k];
+        const bool *held = events->players[i].input.movements_held;
+        PlayerData *player = &state->player_data[i];
+        game_pos_t x = player->x;
+        game_pos_t y = player->y;
+        game_pos_t to_x = x;
+        game_pos_t to_y = y;
+        if (held[0]) to_x -= PLAYER_SPEED;
+        if (held[1]) to_x += PLAYER_SPEED;
+        if (held[2]) to_y -= PLAYER_SPEED;
+        if (held[3]) to_y += PLAYER_SPEED;
+        if (to_x != x && all_pairs_blocked(before, i, x, y, to_x, y)) to_x = x;
+        if (to_y != y && all_pairs_blocked(before, i, to_x, y, to_x, to_y)) to_y = y;
+        player->x = to_x;
+        player->y = to_y;
+    }
+}
+
+void bench_collision(void)
+{
+    // Players packed at a constant density so about the same share are touching at every count
+    // game_simulate() with the spatial hash against testing every pair, from the same start and events
+    printf("%-8s %16s %18s %10s %10s\n", "bodies", "grid (us/frame)", "all pairs (us/frame)", "speedup", "identical");
+
+    for (size_t n = 0; n < sizeof(body_counts) / sizeof(body_counts[0]); ++n)
+    {
+        int count = body_counts[n];
+        int side = BODY_SPACING;
+        while ((side / BODY_SPACING) * (side / BODY_SPACING) < count) side += BODY_SPACING;
+        uint32_t seed = 77;
+
+        GameState *initial = game_state_alloc(count);
+        GameState *grid_state = game_state_alloc(count);
+        GameState *pairs_state = game_state_alloc(count);
+        GameState *before = game_state_alloc(count);
+        GameEvents *events = game_events_alloc(count);
+        bench_random_state(initial, count, &seed);
+        for (int i = 0; i < count; ++i)
+        {
+            initial->player_data[i].x = GAME_POS(bench_random(&seed) % side);
+            initial->player_data[i].y = GAME_POS(bench_random(&seed) % side);
+        }
+        bench_random_events(events, &seed);
+
+        // Capped so players held in one direction stay well inside the 16.16 position range
+        int grid_frames = BODY_UPDATES / count;
+        if (grid_frames > MAX_FRAMES) grid_frames = MAX_FRAMES;
+        int pairs_frames = (int)(PAIR_TESTS / ((long long)count * count));
+        if (pairs_frames < 1) pairs_frames = 1;
+        if (pairs_frames > grid_frames) pairs_frames = grid_frames;
+
+        game_state_copy(grid_state, initial);
+        double start = bench_now();
+        for (int f = 0; f < grid_frames; ++f) game_simulate(grid_state, events, grid_state);
+        double grid_us = (bench_now() - start) * 1e6 / grid_frames;
+
+        // Compare over the frames both ran
+        game_state_copy(grid_state, initial);
+        for (int f = 0; f < pairs_frames; ++f) game_simulate(grid_state, events, grid_state);
+
+        game_state_copy(pairs_state, initial);
+        start = bench_now();
+        for (int f = 0; f < pairs_frames; ++f) all_pairs_simulate(pairs_state, events, before);
+        double pairs_us = (bench_now() - start) * 1e6 / pairs_frames;
+
+        bool identical = game_state_hash(grid_state) == game_state_hash(pairs_state);
+        printf("%-8d %16.2f %18.2f %9.2fx %10s\n", count, grid_us, pairs_us, pairs_us / grid_us, identical ? "yes" : "NO");
+
+        free(initial);
+        free(grid_state);
+        free(pairs_state);
+        free(before);
+        free(events);
+    }
+}
@@ -0,0 +1,58 @@
+#include "../shared/gameimpl.h"
+#include "bench.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define REPLAY_CAPACITY 64
+#define REPLAY_FRAMES 20000
+#define REPLAY_ROUNDS 50
+
+static void record_events(GameEvents **events, uint32_t *seed)
+{
+    // Integer only so the stream is the same whatever the build
+    // Players join early and drop out and back in over the run
+    for (int f = 0; f < REPLAY_FRAMES; ++f)
+    {
+        bench_random_events(events[f], seed);
+        for (int i = 0; i < REPLAY_CAPACITY; ++i)
+        {
+            uint32_t roll = bench_random(seed) % 512;
+            if (f == i || roll == 0) game_events_set(events[f], i, PLAYER_EVENT_JOIN);
+            else if (roll == 1) game_events_set(events[f], i, PLAYER_EVENT_LEAVE);
+        }
+    }
+}
+
+void bench_determinism(void)
+{
+    // Replays a fixed event stream and prints the game_state_hash() of every frame chained together
+    // run-determinism.sh builds this with different compiler flags and compares the hashes
+    GameEvents **events = malloc(REPLAY_FRAMES * sizeof(GameEvents *));
+    for (int f = 0; f < REPLAY_FRAMES; ++f) events[f] = game_events_alloc(REPLAY_CAPACITY);
+    uint32_t seed = 2024;
+    record_events(events, &seed);
+
+    GameState *states[2] = {game_state_alloc(REPLAY_CAPACITY), game_state_alloc(REPLAY_CAPACITY)};
+    uint64_t hash = 0;
+    double start = bench_now();
+    for (int r = 0; r < REPLAY_ROUNDS; ++r)
+    {
+        game_state_init(states[0], REPLAY_CAPACITY);
+        hash = 0xcbf29ce484222325ull;
+        for (int f = 0; f < REPLAY_FRAMES; ++f)
+        {
+            game_simulate(states[f % 2], events[f], states[(f + 1) % 2]);
+            hash = (hash ^ game_state_hash(states[(f + 1) % 2])) * 0x100000001b3ull;
+        }
+    }
+    double frame_ns = (bench_now() - start) * 1e9 / ((double)REPLAY_ROUNDS * REPLAY_FRAMES);
+
+    printf("%-12s %16s %16s\n", "positions", "ns / frame", "hash");
+    printf("%-12s %16.1f %16" PRIx64 "\n", GAME_FIXED_POINT ? "fixed 16.16" : "float", frame_ns, hash);
+
+    free(states[0]);
+    free(states[1]);
+    for (int f = 0; f < REPLAY_FRAMES; ++f) free(events[f]);
+    free(events);
+}
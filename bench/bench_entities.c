@@ -0,0 +1,146 @@
+#include "../shared/entitypool.h"
+#include "../shared/gameimpl.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ENTITY_UPDATES 20000000
+#define ENTITY_TTL_MAX 16
+
+static const int entity_counts[] = {256, 4096, 65535};
+
+typedef struct
+{
+    int count;
+    Entity **entities;
+} MallocEntities;
+
+static Entity bench_random_entity(uint32_t *seed)
+{
+    Entity entity = {0};
+    entity.x = GAME_POS(bench_random(seed) % 800);
+    entity.y = GAME_POS(bench_random(seed) % 800);
+    entity.vx = GAME_POS((int)(bench_random(seed) % 9) - 4);
+    entity.vy = GAME_POS((int)(bench_random(seed) % 9) - 4);
+    entity.owner = (uint16_t)(bench_random(seed) % BENCH_CAPACITY);
+    entity.ttl = (uint16_t)(1 + bench_random(seed) % ENTITY_TTL_MAX);
+    return entity;
+}
+
+static void pool_frame(EntityPool *pool, uint32_t *seed)
+{
+    // Move everything and despawn what expires walking backwards past the swapped in ones,
+    // then spawn back up to capacity so about an eighth of the entities churn every frame
+    Entity *entities = entity_pool_entities(pool);
+    for (int i = pool->count - 1; i >= 0; --i)
+    {
+        entities[i].x += entities[i].vx;
+        entities[i].y += entities[i].vy;
+        if (--entities[i].ttl == 0) entity_pool_remove(pool, i);
+    }
+    while (pool->count < pool->capacity)
+    {
+        Entity entity = bench_random_entity(seed);
+        entity_pool_spawn(pool, &entity);
+    }
+}
+
+static void malloc_frame(MallocEntities *list, int capacity, uint32_t *seed)
+{
+    // Same frame with every entity its own allocation
+    for (int i = list->count - 1; i >= 0; --i)
+    {
+        Entity *entity = list->entities[i];
+        entity->x += entity->vx;
+        entity->y += entity->vy;
+        if (--entity->ttl == 0)
+        {
+            free(entity);
+            list->entities[i] = list->entities[--list->count];
+        }
+    }
+    while (list->count < capacity)
+    {
+        Entity *entity = malloc(sizeof(Entity));
+        *entity = bench_random_entity(seed);
+        list->entities[list->count++] = entity;
+    }
+}
+
+static void malloc_snapshot(MallocEntities *out, const MallocEntities *list)
+{
+    // Deep copy, what rolling back pointer based storage needs
+    for (int i = 0; i < out->count; ++i) free(out->entities[i]);
+    for (int i = 0; i < list->count; ++i)
+    {
+        out->entities[i] = malloc(sizeof(Entity));
+        *out->entities[i] = *list->entities[i];
+    }
+    out->count = list->count;
+}
+
+void bench_entities(void)
+{
+    // Spawn heavy frames, entities live 1 to ENTITY_TTL_MAX frames and are respawned as soon as they go
+    // The pool against a malloc per entity, both stepping and snapshotting every frame
+    printf("%-9s %14s %16s %8s %15s %17s %8s %10s\n", "entities", "pool (us/frame)", "malloc (us/frame)", "speedup",
+           "pool snap (us)", "malloc snap (us)", "speedup", "identical");
+
+    for (size_t n = 0; n < sizeof(entity_counts) / sizeof(entity_counts[0]); ++n)
+    {
+        int capacity = entity_counts[n];
+        int frames = ENTITY_UPDATES / capacity;
+
+        EntityPool *pool = malloc(entity_pool_size(capacity));
+        EntityPool *pool_snapshot = malloc(entity_pool_size(capacity));
+        MallocEntities list = {0, malloc(capacity * sizeof(Entity *))};
+        MallocEntities list_snapshot = {0, malloc(capacity * sizeof(Entity *))};
+        entity_pool_init(pool, capacity);
+        entity_pool_init(pool_snapshot, capacity);
+
+        double pool_seconds = 0.0, pool_snap_seconds = 0.0;
+        uint32_t seed = 5;
+        for (int f = 0; f < frames; ++f)
+        {
+            double start = bench_now();
+            pool_frame(pool, &seed);
+            double mid = bench_now();
+            entity_pool_copy(pool_snapshot, pool);
+            pool_seconds += mid - start;
+            pool_snap_seconds += bench_now() - mid;
+        }
+
+        double malloc_seconds = 0.0, malloc_snap_seconds = 0.0;
+        seed = 5;
+        for (int f = 0; f < frames; ++f)
+        {
+            double start = bench_now();
+            malloc_frame(&list, capacity, &seed);
+            double mid = bench_now();
+            malloc_snapshot(&list_snapshot, &list);
+            malloc_seconds += mid - start;
+            malloc_snap_seconds += bench_now() - mid;
+        }
+
+        // Both remove and spawn in the same order so even the dense order should match
+        bool identical = pool->count == list.count;
+        for (int i = 0; identical && i < list.count; ++i)
+        {
+            const Entity *a = &entity_pool_entities(pool)[i];
+            const Entity *b = list.entities[i];
+            identical = a->x == b->x && a->y == b->y && a->vx == b->vx && a->vy == b->vy && a->owner == b->owner && a->ttl == b->ttl && a->type == b->type;
+        }
+
+        double pool_us = pool_seconds * 1e6 / frames, malloc_us = malloc_seconds * 1e6 / frames;
+        double pool_snap_us = pool_snap_seconds * 1e6 / frames, malloc_snap_us = malloc_snap_seconds * 1e6 / frames;
+        printf("%-9d %14.2f %16.2f %7.2fx %15.2f %17.2f %7.2fx %10s\n", capacity, pool_us, malloc_us, malloc_us / pool_us,
+               pool_snap_us, malloc_snap_us, malloc_snap_us / pool_snap_us, identical ? "yes" : "NO");
+
+        for (int i = 0; i < list.count; ++i) free(list.entities[i]);
+        for (int i = 0; i < list_snapshot.count; ++i) free(list_snapshot.entities[i]);
+        free(list.entities);
+        free(list_snapshot.entities);
+        free(pool);
+        free(pool_snapshot);
+    }
+}
@@ -0,0 +1,89 @@
+#include "../shared/framering.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ADVANCE_ITERATIONS 200000
+#define ROLLBACK_ITERATIONS 20000
+
+typedef struct
+{
+    const char *name;
+    FrameRingMode mode;
+    int checkpoint_interval;
+} RingConfig;
+
+static const RingConfig configs[] = {
+    {"every 1", FRAME_RING_CHECKPOINTS, 1},
+    {"every 2", FRAME_RING_CHECKPOINTS, 2},
+    {"every 4", FRAME_RING_CHECKPOINTS, 4},
+    {"every 8", FRAME_RING_CHECKPOINTS, 8},
+    {"every 16", FRAME_RING_CHECKPOINTS, 16},
+    {"every 32", FRAME_RING_CHECKPOINTS, 32},
+    {"every 64", FRAME_RING_CHECKPOINTS, 64},
+    {"undo log", FRAME_RING_UNDO_LOG, 1},
+};
+static const int depths[] = {4, 16, 64};
+
+static void fill_ring(FrameRing *ring, uint32_t *seed)
+{
+    GameState *state = game_state_alloc(ring->capacity);
+    bench_random_state(state, ring->capacity, seed);
+    frame_ring_reset(ring, 0, state);
+    free(state);
+    for (int i = 0; i < FRAME_BUFFER_SIZE; ++i) bench_random_events(frame_ring_events(ring, i), seed);
+}
+
+void bench_framering(void)
+{
+    // Memory against rollback CPU for each checkpoint interval and the undo log
+    // Advancing the head is the steady state cost, rollbacks rewind then re-simulate depth frames
+    printf("%-10s %12s %14s %11s", "history", "memory (KB)", "advance (ns)", "idle (ns)");
+    for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); ++d) printf("   rollback %-2d (us)", depths[d]);
+    printf("\n");
+
+    for (size_t k = 0; k < sizeof(configs) / sizeof(configs[0]); ++k)
+    {
+        const RingConfig *config = &configs[k];
+        uint32_t seed = 1234;
+        FrameRing ring;
+        if (frame_ring_init(&ring, BENCH_CAPACITY, config->mode, config->checkpoint_interval) != 0) continue;
+        fill_ring(&ring, &seed);
+
+        // Keep the head inside the window, the events are reused as the ring wraps
+        double start = bench_now();
+        for (int i = 0; i < ADVANCE_ITERATIONS; ++i) frame_ring_advance(&ring);
+        double advance_ns = (bench_now() - start) * 1e9 / ADVANCE_ITERATIONS;
+
+        // Same again with nobody moving, the undo log only pays for what changes
+        for (int i = 0; i < FRAME_BUFFER_SIZE; ++i) game_events_clear(frame_ring_events(&ring, i));
+        start = bench_now();
+        for (int i = 0; i < ADVANCE_ITERATIONS; ++i) frame_ring_advance(&ring);
+        double idle_ns = (bench_now() - start) * 1e9 / ADVANCE_ITERATIONS;
+
+        printf("%-10s %12.1f %14.1f %11.1f", config->name, frame_ring_memory(&ring) / 1024.0, advance_ns, idle_ns);
+
+        for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); ++d)
+        {
+            int depth = depths[d];
+            fill_ring(&ring, &seed);
+            for (int i = 0; i < FRAME_BUFFER_SIZE / 2; ++i) frame_ring_advance(&ring);
+
+            // Roll back to a frame at a different offset from its checkpoint each time
+            start = bench_now();
+            for (int i = 0; i < ROLLBACK_ITERATIONS; ++i)
+            {
+                int head_frame = ring.head_frame;
+                int rollback_frame = head_frame - depth - i % config->checkpoint_interval;
+                frame_ring_rewind(&ring, rollback_frame);
+                while (ring.head_frame < head_frame) frame_ring_advance(&ring);
+            }
+            double rollback_us = (bench_now() - start) * 1e6 / ROLLBACK_ITERATIONS;
+            printf("   %16.2f", rollback_us);
+        }
+        printf("\n");
+
+        frame_ring_free(&ring);
+    }
+}
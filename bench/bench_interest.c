@@ -0,0 +1,102 @@
+#include "../shared/gameimpl.h"
+#include "../shared/interest.h"
+#include "../shared/protocol.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define INTEREST_FRAMES 30
+#define PLAYER_SPACING 340
+#define TRACKED_CLIENTS 16
+
+static const int player_counts[] = {100, 1000, 4000};
+
+void bench_interest(void)
+{
+    // Everyone connected and holding random keys, spread at a constant density so about the
+    // same number of players are around each client at every count
+    // Bytes the server sends a frame broadcasting every players events to everyone against
+    // only the players around each client. A few clients replay what they are sent to count
+    // frames where their view drifted from the server, which the hash check would resync
+    printf("%-8s %14s %14s %10s %14s %14s %10s\n", "players", "full (KB)", "interest (KB)", "ratio", "per client (B)", "update (us)", "drifted");
+
+    uint8_t *buffer = malloc(MAX_MESSAGE_SIZE);
+    for (size_t n = 0; n < sizeof(player_counts) / sizeof(player_counts[0]); ++n)
+    {
+        int count = player_counts[n];
+        int side = PLAYER_SPACING;
+        while ((side / PLAYER_SPACING) * (side / PLAYER_SPACING) < count) side += PLAYER_SPACING;
+        uint32_t seed = 91;
+
+        Interest interest;
+        GameState *state = game_state_alloc(count);
+        GameEvents *events = game_events_alloc(count);
+        GameEvents *received = game_events_alloc(count);
+        InterestSet *sets = calloc(count, sizeof(InterestSet));
+        GameState *hashed = game_state_alloc(count);
+        GameState *views[TRACKED_CLIENTS];
+        for (int c = 0; c < TRACKED_CLIENTS; ++c) views[c] = game_state_alloc(count);
+        if (interest_init(&interest, count) != 0) continue;
+
+        bench_random_state(state, count, &seed);
+        for (int i = 0; i < count; ++i)
+        {
+            state->player_data[i].x = GAME_POS(bench_random(&seed) % side);
+            state->player_data[i].y = GAME_POS(bench_random(&seed) % side);
+        }
+
+        // Frame 0 has everyone entering every set so is left out of the totals
+        double full_bytes = 0.0, interest_bytes = 0.0, update_seconds = 0.0;
+        int drifted = 0, checked = 0;
+        for (int f = 0; f <= INTEREST_FRAMES; ++f)
+        {
+            bench_random_events(events, &seed);
+            interest_build(&interest, state, events);
+            game_simulate(state, events, state);
+
+            size_t full_size = serialize_s2p_frame_game_events(buffer, f, events, false, 0, 0);
+            size_t frame_bytes = 0;
+            double start = bench_now();
+            for (int c = 0; c < count; ++c)
+            {
+                int frame_count = interest_update(&interest, &sets[c], c, events);
+                size_t msg_size = serialize_s2p_frame_player_frames(buffer, f, interest.frame_slots, interest.frames, frame_count, false, 0, 0);
+                frame_bytes += msg_size;
+                if (c >= TRACKED_CLIENTS) continue;
+
+                // Simulate what the client was sent and resync it like the hash check would
+                double replay_start = bench_now();
+                int frame;
+                bool has_hash;
+                uint32_t state_hash;
+                int frame_advantage;
+                deserialize_s2p_frame_game_events(buffer, msg_size, &frame, received, &has_hash, &state_hash, &frame_advantage);
+                game_simulate(views[c], received, views[c]);
+                if (game_state_hash(views[c]) != interest_set_hash(&interest, &sets[c], state, hashed))
+                {
+                    if (f > 0) drifted++;
+                    interest_set_view(&sets[c], state, events, views[c], received);
+                }
+                if (f > 0) checked++;
+                start += bench_now() - replay_start;
+            }
+            if (f == 0) continue;
+            update_seconds += bench_now() - start;
+            full_bytes += (double)full_size * count;
+            interest_bytes += frame_bytes;
+        }
+
+        printf("%-8d %14.1f %14.1f %9.2fx %14.0f %14.1f %9.2f%%\n", count, full_bytes / INTEREST_FRAMES / 1024.0, interest_bytes / INTEREST_FRAMES / 1024.0,
+               full_bytes / interest_bytes, interest_bytes / INTEREST_FRAMES / count, update_seconds * 1e6 / INTEREST_FRAMES, 100.0 * drifted / checked);
+
+        interest_free(&interest);
+        for (int c = 0; c < count; ++c) interest_set_free(&sets[c]);
+        for (int c = 0; c < TRACKED_CLIENTS; ++c) free(views[c]);
+        free(sets);
+        free(hashed);
+        free(state);
+        free(events);
+        free(received);
+    }
+    free(buffer);
+}
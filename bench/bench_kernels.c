@@ -0,0 +1,102 @@
+#include "../shared/gamekernels.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define KERNEL_UPDATES 20000000
+#define RUN_FRAMES 1000
+#define EVENT_SETS 8
+#define PLAYER_SPACING 50
+
+static const int capacities[] = {8, 16, 64, 256};
+static const int filled_eighths[] = {8, 7, 6, 4, 2};
+
+static void kernel_events(GameEvents **event_sets, uint32_t *seed)
+{
+    // Random keys, with slot 1 leaving and rejoining and slot 2 entering and exiting each cycle
+    // so every event kind goes through both paths
+    for (int s = 0; s < EVENT_SETS; ++s) bench_random_events(event_sets[s], seed);
+    game_events_set(event_sets[0], 1, PLAYER_EVENT_LEAVE);
+    game_events_set(event_sets[4], 1, PLAYER_EVENT_JOIN);
+    game_events_set(event_sets[2], 2, PLAYER_EVENT_ENTER);
+    event_sets[2]->players[2].x = GAME_POS(120);
+    event_sets[2]->players[2].y = GAME_POS(90);
+    game_events_set(event_sets[6], 2, PLAYER_EVENT_EXIT);
+}
+
+static double kernel_run(GameSimulateKernel simulate, const GameState *start, GameEvents *const *event_sets, GameState *state, int runs)
+{
+    // runs of RUN_FRAMES frames from the same start so positions never drift far, returns seconds
+    double seconds = 0.0;
+    for (int r = 0; r < runs; ++r)
+    {
+        game_state_copy(state, start);
+        double begin = bench_now();
+        for (int f = 0; f < RUN_FRAMES; ++f) simulate(state, event_sets[f % EVENT_SETS], state);
+        seconds += bench_now() - begin;
+    }
+    return seconds;
+}
+
+void bench_kernels(void)
+{
+    // game_simulate() against the kernel specialised for the capacity, from full down to a
+    // quarter full. There is none past 64 slots, where the spatial hash wins
+    // Players are packed tight enough that collisions happen and the events include every kind
+    printf("%-9s %7s %15s %15s %8s %10s\n", "capacity", "active", "generic (ns)", "kernel (ns)", "speedup", "identical");
+    if (!GAME_KERNELS)
+    {
+        printf("built with GAME_KERNELS 0\n");
+        return;
+    }
+
+    for (size_t n = 0; n < sizeof(capacities) / sizeof(capacities[0]); ++n)
+    {
+        int capacity = capacities[n];
+        int side = PLAYER_SPACING;
+        while ((side / PLAYER_SPACING) * (side / PLAYER_SPACING) < capacity) side += PLAYER_SPACING;
+        int runs = KERNEL_UPDATES / (capacity * RUN_FRAMES);
+        if (runs < 1) runs = 1;
+
+        for (size_t q = 0; q < sizeof(filled_eighths) / sizeof(filled_eighths[0]); ++q)
+        {
+            uint32_t seed = 29;
+            GameState *start = game_state_alloc(capacity);
+            GameState *generic = game_state_alloc(capacity);
+            GameState *kernel = game_state_alloc(capacity);
+            GameEvents *event_sets[EVENT_SETS];
+            for (int s = 0; s < EVENT_SETS; ++s) event_sets[s] = game_events_alloc(capacity);
+
+            for (int i = 0; i < capacity; ++i)
+            {
+                if (i % 8 >= filled_eighths[q]) continue;
+                start->player_data[i].active = true;
+                start->player_data[i].x = GAME_POS(bench_random(&seed) % side);
+                start->player_data[i].y = GAME_POS(bench_random(&seed) % side);
+            }
+            game_state_rebuild_active(start);
+            kernel_events(event_sets, &seed);
+
+            GameSimulateKernel simulate = game_kernel_simulate(capacity);
+            double generic_seconds = kernel_run(game_simulate, start, event_sets, generic, runs);
+            double kernel_seconds = 0.0;
+            bool identical = false;
+            if (simulate != NULL)
+            {
+                kernel_seconds = kernel_run(simulate, start, event_sets, kernel, runs);
+                identical = game_state_hash(generic) == game_state_hash(kernel) && generic->active_count == kernel->active_count &&
+                            memcmp(game_state_active_slots(generic), game_state_active_slots(kernel), generic->active_count * sizeof(uint16_t)) == 0;
+            }
+            int frames = runs * RUN_FRAMES;
+            double generic_ns = generic_seconds * 1e9 / frames, kernel_ns = kernel_seconds * 1e9 / frames;
+            printf("%-9d %7d %15.0f", capacity, start->active_count, generic_ns);
+            if (simulate != NULL) printf(" %15.0f %7.2fx %10s\n", kernel_ns, generic_ns / kernel_ns, identical ? "yes" : "NO");
+            else printf(" %15s %8s %10s\n", "-", "-", "-");
+
+            free(start);
+            free(generic);
+            free(kernel);
+            for (int s = 0; s < EVENT_SETS; ++s) free(event_sets[s]);
+        }
+    }
+}
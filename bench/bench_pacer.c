@@ -0,0 +1,83 @@
+#include "../shared/pacer.h"
+#include "bench.h"
+#include <stdio.h>
+#include <unistd.h>
+
+#define PACER_SECONDS 1
+#define TICK_WORK_US 2000
+
+static const int tick_rates[] = {30, 60, 120};
+
+static void tick_work(void)
+{
+    // Stands in for a ticks simulation, spinning so the time is the same under load
+    int64_t until = pacer_now_ns() + TICK_WORK_US * 1000LL;
+    while (pacer_now_ns() < until)
+    {
+    }
+}
+
+static void print_row(int rate, const char *method, const PacerStats *stats, double drift_ms)
+{
+    printf("%-6d %-14s %10.1f %10.1f %8lld %10lld %11.3f\n", rate, method, stats->jitter_mean_us, stats->jitter_max_us,
+           (long long)stats->late, (long long)stats->skipped, drift_ms);
+}
+
+static void run_relative(int rate)
+{
+    // Sleeping a period after each tick like a loop without a clock of its own, measured against
+    // the deadlines a pacer would have had
+    Pacer ideal;
+    pacer_init(&ideal, rate, 0);
+    int ticks = PACER_SECONDS * rate;
+    int64_t wake = 0;
+    for (int i = 0; i < ticks; ++i)
+    {
+        tick_work();
+        usleep(1000000 / rate);
+        wake = pacer_now_ns();
+        int64_t jitter = wake - pacer_deadline_ns(&ideal);
+        ideal.tick++;
+        ideal.ticks++;
+        ideal.jitter_sum_ns += (double)jitter;
+        if (jitter > PACER_LATE_NS) ideal.late++;
+        if (jitter > ideal.jitter_max_ns) ideal.jitter_max_ns = jitter;
+    }
+
+    PacerStats stats;
+    pacer_stats(&ideal, &stats);
+    print_row(rate, "sleep", &stats, (double)(wake - (ideal.start_ns + (int64_t)ticks * 1000000000LL / rate)) / 1e6);
+}
+
+static void run_pacer(int rate, const char *method, int64_t spin_ns)
+{
+    Pacer pacer;
+    pacer_init(&pacer, rate, spin_ns);
+    int ticks = PACER_SECONDS * rate;
+    int64_t wake = 0;
+    for (int i = 0; i < ticks; ++i)
+    {
+        tick_work();
+        pacer_wait(&pacer);
+        wake = pacer_now_ns();
+    }
+
+    PacerStats stats;
+    pacer_stats(&pacer, &stats);
+    print_row(rate, method, &stats, (double)(wake - (pacer.start_ns + (int64_t)ticks * 1000000000LL / rate)) / 1e6);
+}
+
+void bench_pacer(void)
+{
+    // Ticks with TICK_WORK_US of work each, paced by sleeping a period after the work against
+    // the pacer sleeping to absolute deadlines, without and with its spin tail
+    // Jitter is how long after its deadline each tick started, late the ticks over PACER_LATE_NS
+    // and drift how far the last tick was from where it should have been
+    printf("%-6s %-14s %10s %10s %8s %10s %11s\n", "rate", "method", "mean (us)", "max (us)", "late", "skipped", "drift (ms)");
+    for (size_t n = 0; n < sizeof(tick_rates) / sizeof(tick_rates[0]); ++n)
+    {
+        run_relative(tick_rates[n]);
+        run_pacer(tick_rates[n], "abstime", 0);
+        run_pacer(tick_rates[n], "abstime+spin", SIMULATION_SPIN_NS);
+    }
+}
@@ -0,0 +1,69 @@
+#include "../shared/gamejobs.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PLAYER_UPDATES 10000000
+#define EVENT_FRAMES 4
+
+static const int capacities[] = {4096, 16384, 65536};
+static const int thread_counts[] = {1, 2, 4, 8};
+
+void bench_parallel(void)
+{
+    // One large world simulated with game_simulate() against the worker pool at each thread count
+    // Scaling is bounded by the cores available and by memory bandwidth, movement is a few adds
+    printf("%ld cores online\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-9s %-8s %14s %10s %10s\n", "players", "threads", "ns / player", "speedup", "identical");
+
+    for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); ++c)
+    {
+        int capacity = capacities[c];
+        int frames = PLAYER_UPDATES / capacity;
+
+        // A few players leave and join every frame so the serial event phase is exercised too
+        uint32_t seed = 5;
+        GameState *initial = game_state_alloc(capacity);
+        GameState *reference = game_state_alloc(capacity);
+        GameState *result = game_state_alloc(capacity);
+        GameEvents *events[EVENT_FRAMES];
+        bench_random_state(initial, capacity, &seed);
+        for (int f = 0; f < EVENT_FRAMES; ++f)
+        {
+            events[f] = game_events_alloc(capacity);
+            bench_random_events(events[f], &seed);
+            for (int i = 0; i < 8; ++i)
+            {
+                game_events_set(events[f], bench_random(&seed) % capacity, f % 2 ? PLAYER_EVENT_JOIN : PLAYER_EVENT_LEAVE);
+            }
+        }
+
+        game_state_copy(reference, initial);
+        double start = bench_now();
+        for (int f = 0; f < frames; ++f) game_simulate(reference, events[f % EVENT_FRAMES], reference);
+        double serial_ns = (bench_now() - start) * 1e9 / ((double)frames * capacity);
+        printf("%-9d %-8s %14.3f %10s %10s\n", capacity, "serial", serial_ns, "1.00x", "-");
+
+        for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); ++t)
+        {
+            GameJobPool pool;
+            if (game_jobs_init(&pool, thread_counts[t]) != 0) continue;
+
+            game_state_copy(result, initial);
+            start = bench_now();
+            for (int f = 0; f < frames; ++f) game_simulate_parallel(&pool, result, events[f % EVENT_FRAMES], result);
+            double parallel_ns = (bench_now() - start) * 1e9 / ((double)frames * capacity);
+            game_jobs_free(&pool);
+
+            bool identical = game_state_hash(result) == game_state_hash(reference) && result->active_count == reference->active_count;
+            printf("%-9s %-8d %14.3f %9.2fx %10s\n", "", thread_counts[t], parallel_ns, serial_ns / parallel_ns, identical ? "yes" : "NO");
+        }
+
+        for (int f = 0; f < EVENT_FRAMES; ++f) free(events[f]);
+        free(initial);
+        free(reference);
+        free(result);
+    }
+}
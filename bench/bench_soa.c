@@ -0,0 +1,139 @@
+#include "../shared/gamesoa.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PLAYER_UPDATES 20000000
+
+typedef void (*SoAKernel)(GameStateSoA *state, const GameEventsSoA *events);
+
+typedef struct
+{
+    const char *name;
+    SoAKernel kernel;
+} KernelConfig;
+
+static const KernelConfig kernels[] = {
+    {"soa scalar", game_simulate_soa_scalar},
+#ifdef __SSE2__
+    {"soa sse2", game_simulate_soa_sse2},
+#endif
+#ifdef __AVX2__
+    {"soa avx2", game_simulate_soa_avx2},
+#endif
+};
+
+static const int entity_counts[] = {10, 1000, 100000};
+
+static void random_world_events(GameEvents *events, uint32_t *seed)
+{
+    // Mostly movement with the odd join and leave so every branch gets covered
+    bench_random_events(events, seed);
+    for (int i = 0; i < events->capacity; ++i)
+    {
+        uint32_t roll = bench_random(seed) % 64;
+        if (roll == 0) game_events_set(events, i, PLAYER_EVENT_JOIN);
+        if (roll == 1) game_events_set(events, i, PLAYER_EVENT_LEAVE);
+    }
+}
+
+static bool states_identical(const GameState *a, const GameState *b)
+{
+    // Positions of inactive players are not kept in sync by game_state_copy()
+    if (a->active_count != b->active_count) return false;
+    for (int i = 0; i < a->capacity; ++i)
+    {
+        const PlayerData *pa = &a->player_data[i];
+        const PlayerData *pb = &b->player_data[i];
+        if (pa->active != pb->active) return false;
+        if (!pa->active) continue;
+        if (memcmp(&pa->x, &pb->x, sizeof(game_pos_t)) != 0 || memcmp(&pa->y, &pb->y, sizeof(game_pos_t)) != 0) return false;
+    }
+    return true;
+}
+
+void bench_soa(void)
+{
+    // Entities are players split into worlds of BENCH_CAPACITY, the AoS path simulates each world
+    // with game_simulate() while the SoA kernels run over every player in one pass
+    printf("%-10s %-12s %14s %10s %10s\n", "entities", "kernel", "ns / entity", "speedup", "identical");
+
+    for (size_t n = 0; n < sizeof(entity_counts) / sizeof(entity_counts[0]); ++n)
+    {
+        int world_count = (entity_counts[n] + BENCH_CAPACITY - 1) / BENCH_CAPACITY;
+        int player_count = world_count * BENCH_CAPACITY;
+        int frames = PLAYER_UPDATES / player_count;
+
+        uint32_t seed = 42;
+        GameState **initial = malloc(world_count * sizeof(GameState *));
+        GameState **reference = malloc(world_count * sizeof(GameState *));
+        GameState **result = malloc(world_count * sizeof(GameState *));
+        GameEvents **events = malloc(world_count * sizeof(GameEvents *));
+        for (int w = 0; w < world_count; ++w)
+        {
+            initial[w] = game_state_alloc(BENCH_CAPACITY);
+            reference[w] = game_state_alloc(BENCH_CAPACITY);
+            result[w] = game_state_alloc(BENCH_CAPACITY);
+            events[w] = game_events_alloc(BENCH_CAPACITY);
+            bench_random_state(initial[w], BENCH_CAPACITY, &seed);
+            random_world_events(events[w], &seed);
+            game_state_copy(reference[w], initial[w]);
+        }
+
+        // AoS reference
+        double start = bench_now();
+        for (int f = 0; f < frames; ++f)
+        {
+            for (int w = 0; w < world_count; ++w) game_simulate(reference[w], events[w], reference[w]);
+        }
+        double aos_ns = (bench_now() - start) * 1e9 / ((double)frames * player_count);
+        printf("%-10d %-12s %14.3f %10s %10s\n", player_count, "aos", aos_ns, "1.00x", "-");
+
+        GameStateSoA soa_state;
+        GameEventsSoA soa_events;
+        game_pos_t *from_x = malloc(player_count * sizeof(game_pos_t));
+        game_pos_t *from_y = malloc(player_count * sizeof(game_pos_t));
+        if (game_soa_init(&soa_state, &soa_events, player_count) != 0) continue;
+        for (int w = 0; w < world_count; ++w) game_soa_load_events(&soa_events, w * BENCH_CAPACITY, events[w]);
+
+        for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k)
+        {
+            for (int w = 0; w < world_count; ++w) game_soa_load_state(&soa_state, w * BENCH_CAPACITY, initial[w]);
+
+            start = bench_now();
+            // Collisions are per world so they run after each kernel pass
+            for (int f = 0; f < frames; ++f)
+            {
+                memcpy(from_x, soa_state.x, player_count * sizeof(game_pos_t));
+                memcpy(from_y, soa_state.y, player_count * sizeof(game_pos_t));
+                kernels[k].kernel(&soa_state, &soa_events);
+                game_soa_collide(&soa_state, &soa_events, from_x, from_y, BENCH_CAPACITY, 1, BENCH_CAPACITY, world_count);
+            }
+            double soa_ns = (bench_now() - start) * 1e9 / ((double)frames * player_count);
+
+            bool identical = true;
+            for (int w = 0; w < world_count; ++w)
+            {
+                game_soa_store_state(&soa_state, w * BENCH_CAPACITY, result[w]);
+                identical &= states_identical(result[w], reference[w]);
+            }
+            printf("%-10s %-12s %14.3f %9.2fx %10s\n", "", kernels[k].name, soa_ns, aos_ns / soa_ns, identical ? "yes" : "NO");
+        }
+
+        game_soa_free(&soa_state, &soa_events);
+        free(from_x);
+        free(from_y);
+        for (int w = 0; w < world_count; ++w)
+        {
+            free(initial[w]);
+            free(reference[w]);
+            free(result[w]);
+            free(events[w]);
+        }
+        free(initial);
+        free(reference);
+        free(result);
+        free(events);
+    }
+}
@@ -0,0 +1,48 @@
+// cbuild: -I../ -O2 -march=native -DGAME_KERNELS=1
+// cbuild: bench.c bench_batch.c bench_capacity.c bench_collision.c bench_determinism.c bench_entities.c bench_framering.c bench_interest.c bench_kernels.c bench_pacer.c bench_parallel.c bench_soa.c
+// cbuild: ../shared/gameimpl.c ../shared/gamekernels.c ../shared/entitypool.c ../shared/spatialhash.c ../shared/interest.c ../shared/protocol.c ../shared/gamesoa.c ../shared/gamebatch.c ../shared/gamejobs.c ../shared/framering.c ../shared/pacer.c ../shared/log.c -lm
+
+#include "../shared/log.h"
+#include "bench.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct
+{
+    const char *name;
+    void (*run)(void);
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    {"batch", bench_batch},
+    {"capacity", bench_capacity},
+    {"collision", bench_collision},
+    {"determinism", bench_determinism},
+    {"entities", bench_entities},
+    {"framering", bench_framering},
+    {"interest", bench_interest},
+    {"kernels", bench_kernels},
+    {"pacer", bench_pacer},
+    {"parallel", bench_parallel},
+    {"soa", bench_soa},
+};
+
+int main(int argc, char **argv)
+{
+    // Run the benchmarks named on the command line, or all of them
+    log_set_enabled(false);
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i)
+    {
+        bool selected = argc < 2;
+        for (int j = 1; j < argc; ++j)
+        {
+            if (strcmp(argv[j], benchmarks[i].name) == 0) selected = true;
+        }
+        if (!selected) continue;
+
+        printf("== %s ==\n", benchmarks[i].name);
+        benchmarks[i].run();
+        printf("\n");
+    }
+    return 0;
+}
@@ -1,15 +1,26 @@
 #include "gameclient.h"
 #include "../shared/log.h"
+#include "../shared/pacer.h"
 #include <arpa/inet.h>
 #include <assert.h>
 #include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <pthread.h>
 #include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+static double game_client_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
 int game_client_init(GameClient *client, const char *server_ip, int port)
 {
     // Initialize game client state
@@ -19,14 +30,42 @@ int game_client_init(GameClient *client, const char *server_ip, int port)
 
     client->socket_fd = -1;
     client->recv_thread = 0;
-    pthread_mutex_init(&client->state_lock, NULL);
+    if (message_queue_init(&client->recv_queue) != 0)
+    {
+        return 1;
+    }
+    pthread_mutex_init(&client->send_lock, NULL);
+    pthread_mutex_init(&client->rtt_lock, NULL);
+    rtt_estimator_init(&client->rtt);
 
     client->client_index = -1;
     client->sync_frame = -1;
     client->server_frame = -1;
     client->client_frame = -1;
-    memset(client->states, 0, sizeof(client->states));
-    memset(client->events, 0, sizeof(client->events));
+    client->pending_frames = 0;
+    client->reconcile_budget = RECONCILE_FRAME_BUDGET;
+    client->resim_frame = -1;
+    client->resim_dirty = false;
+    client->hash_frame = -1;
+    client->hash_value = 0;
+    client->resync_requested = false;
+    client->resync_request_time = 0.0;
+    client->frame_advantage = 0.0;
+    client->input_delay_mode = INPUT_DELAY_MODE;
+    client->input_delay = client->input_delay_mode == INPUT_DELAY_FIXED ? INPUT_DELAY_FRAMES : 0;
+    client->input_frame = -1;
+    client->input_delay_frame = -1;
+    memset(client->input_sent_times, 0, sizeof(client->input_sent_times));
+    rtt_estimator_init(&client->input_rtt);
+    client->rollback_count = 0;
+    client->rollback_depth_sum = 0;
+    client->rollback_depth_max = 0;
+    client->speculate = CLIENT_SPECULATION;
+    memset(&client->speculation, 0, sizeof(client->speculation));
+
+    // Sized by the server capacity so only allocated once initialised
+    memset(&client->frames, 0, sizeof(client->frames));
+    client->predicted_state = NULL;
 
     // Ceate socket and connect to localhost:PORT
     client->socket_fd = socket(AF_INET, SOCK_STREAM, 0);
@@ -49,6 +88,10 @@ int game_client_init(GameClient *client, const char *server_ip, int port)
         return 1;
     }
 
+    // Every message is small and wanted straight away, do not hold them back to coalesce
+    int nodelay = 1;
+    if (setsockopt(client->socket_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) != 0) perror("setsockopt()");
+
     // Start server listening thread
     ret = pthread_create(&client->recv_thread, NULL, game_client_recv_thread, client);
     if (ret != 0)
@@ -84,32 +127,88 @@ void game_client_shutdown(GameClient *client)
         pthread_join(client->recv_thread, NULL);
     }
 
+    if (client->speculation.capacity > 0)
+    {
+        speculation_log_stats(&client->speculation);
+        speculation_free(&client->speculation);
+    }
+    rtt_estimator_log_stats(&client->rtt, "Server");
+    pthread_mutex_destroy(&client->rtt_lock);
+    pthread_mutex_destroy(&client->send_lock);
+    frame_ring_free(&client->frames);
+    free(client->predicted_state);
+    client->predicted_state = NULL;
+    message_queue_free(&client->recv_queue);
+
     log_printf("Game client shutdown\n");
 }
 
+static ssize_t game_client_send(GameClient *client, const uint8_t *buffer, size_t msg_size)
+{
+    // Every send goes through here so messages from different threads never interleave
+    ssize_t sent;
+    pthread_mutex_lock(&client->send_lock);
+    {
+        sent = send_message(client->socket_fd, buffer, msg_size);
+    }
+    pthread_mutex_unlock(&client->send_lock);
+    return sent;
+}
+
+static void game_client_handle_ping(GameClient *client, const MessageHeader *header, const uint8_t *buffer, size_t message_size)
+{
+    int frame;
+    int64_t origin_ns;
+    int64_t reply_ns;
+    deserialize_ping(buffer, message_size, &frame, &origin_ns, &reply_ns);
+    int64_t now_ns = pacer_now_ns();
+
+    if (header->type == MSG_PING)
+    {
+        uint8_t reply[sizeof(MessageHeader) + sizeof(PingPayload)];
+        size_t msg_size = serialize_ping(reply, MSG_PONG, frame, origin_ns, now_ns);
+        if (game_client_send(client, reply, msg_size) < 0) log_printf("Client failed to send MSG_PONG\n");
+        return;
+    }
+
+    pthread_mutex_lock(&client->rtt_lock);
+    {
+        rtt_estimator_add_ping(&client->rtt, origin_ns, reply_ns, now_ns);
+    }
+    pthread_mutex_unlock(&client->rtt_lock);
+}
+
 void *game_client_recv_thread(void *arg)
 {
     GameClient *client = (GameClient *)arg;
 
     // Keep receiving until signalled to shutdown
-    uint8_t buffer[MAX_MESSAGE_SIZE];
+    // Messages are only queued here, the main loop applies them at the start of its tick
     while (!atomic_load(&client->to_shutdown))
     {
-        ssize_t message_size = recv(client->socket_fd, buffer, sizeof(buffer), 0);
-        if (message_size <= 0) break;
+        QueuedMessage *message = message_queue_begin_push(&client->recv_queue);
+        if (message == NULL)
+        {
+            // Main loop has fallen behind, leave the rest in the socket for now
+            usleep(1000);
+            continue;
+        }
 
-        // Peek and parse just the header so we can switch on the type
-        // We make the assumption at this point 1 TCP recv = 1 game message
-        assert(message_size >= sizeof(MessageHeader));
+        ssize_t message_size = recv_message(client->socket_fd, message->data, sizeof(message->data));
+        if (message_size <= 0) break;
 
+        // Pings are answered and timed here rather than waiting for the next tick, the slot
+        // is left for the next message
         MessageHeader header;
-        memcpy(&header, buffer, sizeof(header));
-
-        uint16_t payload_size = ntohs(header.payload_size);
-        assert(message_size == (sizeof(header) + payload_size));
+        memcpy(&header, message->data, sizeof(header));
+        if (header.type == MSG_PING || header.type == MSG_PONG)
+        {
+            game_client_handle_ping(client, &header, message->data, (size_t)message_size);
+            continue;
+        }
 
-        // Now hand this over to be handled
-        game_client_handle_payload(client, &header, buffer, (size_t)message_size);
+        message->size = (size_t)message_size;
+        message_queue_end_push(&client->recv_queue);
     }
 
     atomic_store(&client->is_connected, false);
@@ -117,32 +216,62 @@ void *game_client_recv_thread(void *arg)
     return NULL;
 }
 
+void game_client_poll_messages(GameClient *client)
+{
+    // Handle every message queued by the receive thread so far
+    const QueuedMessage *message;
+    while ((message = message_queue_front(&client->recv_queue)) != NULL)
+    {
+        MessageHeader header;
+        memcpy(&header, message->data, sizeof(header));
+        game_client_handle_payload(client, &header, (char *)message->data, message->size);
+        message_queue_pop(&client->recv_queue);
+    }
+}
+
 void game_client_handle_payload(GameClient *client, MessageHeader *header, char *buffer, size_t message_size)
 {
     switch (header->type)
     {
     case MSG_S2P_INIT_PLAYER:
     {
+        // Allocate everything for the server capacity before deserializing into it
+        int capacity = deserialize_init_player_capacity((uint8_t *)buffer, message_size);
+        client->predicted_state = game_state_alloc(capacity);
+        GameEvents *current_events = game_events_alloc(capacity);
+        if (client->predicted_state == NULL || current_events == NULL ||
+            frame_ring_init(&client->frames, capacity, STATE_HISTORY_MODE, STATE_CHECKPOINT_INTERVAL) != 0)
+        {
+            log_printf("Failed to allocate for capacity %d\n", capacity);
+            free(current_events);
+            atomic_store(&client->is_connected, false);
+            break;
+        }
+
         int frame;
         int client_index;
-        GameState current_state;
-        GameEvents current_events;
-        deserialize_init_player((uint8_t *)buffer, message_size, &frame, &current_state, &current_events, &client_index);
+        deserialize_init_player((uint8_t *)buffer, message_size, &frame, client->predicted_state, current_events, &client_index);
 
-        log_printf("Received MSG_S2P_INIT_PLAYER as player %u\n", client_index);
+        log_printf("Received MSG_S2P_INIT_PLAYER as player %u of %d\n", client_index, capacity);
 
         // Initialize player with the given frame, events, state
-        pthread_mutex_lock(&client->state_lock);
+        // The events for this frame are not final yet so the server will still send them
+        client->client_index = client_index;
+        client->sync_frame = frame;
+        client->server_frame = frame - 1;
+        client->client_frame = frame;
+        client->input_frame = frame - 1;
+        client->input_delay_frame = frame;
+        frame_ring_reset(&client->frames, frame, client->predicted_state);
+        game_events_copy(frame_ring_events(&client->frames, frame), current_events);
+        free(current_events);
+
+        // Speculation is only an optimisation so carry on without it
+        if (client->speculate && speculation_init(&client->speculation, capacity) != 0)
         {
-            int frame = ntohl(header->frame);
-            client->client_index = client_index;
-            client->sync_frame = frame;
-            client->server_frame = frame;
-            client->client_frame = frame;
-            client->states[client->sync_frame % FRAME_BUFFER_SIZE] = current_state;
-            client->events[client->sync_frame % FRAME_BUFFER_SIZE] = current_events;
+            log_printf("Failed to start speculation, disabling it\n");
+            client->speculate = false;
         }
-        pthread_mutex_unlock(&client->state_lock);
 
         atomic_store_explicit(&client->is_initialised, true, memory_order_release);
         break;
@@ -150,30 +279,102 @@ void game_client_handle_payload(GameClient *client, MessageHeader *header, char
 
     case MSG_S2P_FRAME_GAME_EVENTS:
     {
-        int frame;
-        GameEvents server_frame_events;
-        deserialize_s2p_frame_game_events((uint8_t *)buffer, message_size, &frame, &server_frame_events);
+        // Peek the frame first so the events can be deserialized straight into the ring
+        int frame = ntohl(header->frame);
 
         log_printf("Received MSG_S2P_FRAME_GAME_EVENTS for frame %u\n", frame);
 
-        pthread_mutex_lock(&client->state_lock);
+        // Expect to receive the servers next frame for now
+        if (frame != client->server_frame + 1)
         {
-            // Expect to receive the servers next frame for now
-            // If server was on frame 0 when we joined it will send that out again
-            if (frame != client->server_frame + 1 && frame != 0)
-            {
-                log_printf("WARN: Server frame %u unexpected, expected %d or 0\n", frame, client->server_frame + 1);
-                pthread_mutex_unlock(&client->state_lock);
-                break;
-            }
+            log_printf("WARN: Server frame %u unexpected, expected %d\n", frame, client->server_frame + 1);
+            break;
+        }
+
+        // Overwrite local game events with servers straight into the ring
+        // Reconciliation is deferred to the main loop so back to back frames get coalesced
+        bool has_hash;
+        uint32_t state_hash;
+        int frame_advantage;
+        client->server_frame = frame;
+        deserialize_s2p_frame_game_events((uint8_t *)buffer, message_size, &frame, frame_ring_events(&client->frames, frame), &has_hash, &state_hash,
+                                          &frame_advantage);
+
+        // Each frames advantage depends on when the last inputs happened to arrive so smooth it
+        client->frame_advantage += ((double)frame_advantage / FRAME_ADVANTAGE_SCALE - client->frame_advantage) * TIME_SYNC_SMOOTHING;
+
+        // The frame being confirmed is a round trip for the input sent for it, timed from when
+        // it was sent to the tick it can be used on as that is when it stops any rollback
+        double *sent_time = &client->input_sent_times[frame % FRAME_BUFFER_SIZE];
+        if (*sent_time > 0.0)
+        {
+            rtt_estimator_add(&client->input_rtt, game_client_now() - *sent_time);
+            *sent_time = 0.0;
+        }
+
+        // Hash is of the state after this frame, checked once that state is confirmed
+        // Only one is kept at a time so a slow reconcile still gets to check the older one
+        if (has_hash && client->hash_frame < 0)
+        {
+            client->hash_frame = frame + 1;
+            client->hash_value = state_hash;
+        }
+        client->pending_frames++;
+        break;
+    }
+
+    case MSG_S2P_STATE_RESYNC:
+    {
+        GameEvents *resync_events = game_events_alloc(client->frames.capacity);
+        if (resync_events == NULL)
+        {
+            perror("malloc()");
+            break;
+        }
+
+        int frame;
+        deserialize_s2p_state_resync((uint8_t *)buffer, message_size, &frame, client->predicted_state, resync_events);
+
+        log_printf("Received MSG_S2P_STATE_RESYNC for frame %d\n", frame);
+
+        // The server cannot be past frames it has not had inputs for so this is never ahead
+        // Keep the local inputs for frames since, the server already has them too, including
+        // any scheduled past the prediction by the input delay
+        assert(frame >= client->sync_frame && frame <= client->input_frame + 1);
+        PlayerInput local_inputs[FRAME_BUFFER_SIZE];
+        int local_count = client->input_frame + 1 - frame;
+        for (int i = 0; i < local_count; ++i)
+        {
+            local_inputs[i] = frame_ring_events(&client->frames, frame + i)->players[client->client_index].input;
+        }
+
+        // Jump to the servers state and predict forward again to the current frame
+        // With an input delay the server can be ahead of the prediction, which jumps to it
+        int predicted_frames = frame < client->client_frame ? client->client_frame - frame : 0;
+        if (client->client_frame < frame) client->client_frame = frame;
+        frame_ring_reset(&client->frames, frame, client->predicted_state);
+        game_events_copy(frame_ring_events(&client->frames, frame), resync_events);
+        free(resync_events);
+        for (int i = 0; i < local_count; ++i)
+        {
+            frame_ring_events(&client->frames, frame + i)->players[client->client_index].input = local_inputs[i];
+        }
+        while (client->frames.head_frame < client->client_frame) frame_ring_advance(&client->frames);
 
-            // Overwrite local game events with servers
-            client->server_frame = frame;
-            client->events[frame % FRAME_BUFFER_SIZE] = server_frame_events;
+        client->sync_frame = frame;
+        client->server_frame = frame - 1;
+        client->pending_frames = 0;
+        client->resim_frame = -1;
+        client->resim_dirty = false;
+        client->hash_frame = -1;
+        if (client->speculate) speculation_invalidate(&client->speculation);
 
-            game_client_reconcile_frames(client);
+        if (client->resync_requested)
+        {
+            double recovery_ms = (game_client_now() - client->resync_request_time) * 1000.0;
+            log_printf("Resynced to frame %d in %.2f ms (%d frames predicted)\n", frame, recovery_ms, predicted_frames);
+            client->resync_requested = false;
         }
-        pthread_mutex_unlock(&client->state_lock);
         break;
     }
 
@@ -183,52 +384,249 @@ void game_client_handle_payload(GameClient *client, MessageHeader *header, char
     }
 }
 
+static bool game_client_apply_speculation(GameClient *client, bool *eligible)
+{
+    // Only a single new frame straight after the confirmed one can have been guessed
+    int frame = client->server_frame;
+    *eligible = client->resim_frame < 0 && client->pending_frames == 1 && frame == client->sync_frame + 1;
+    if (!*eligible) return false;
+
+    Speculation *spec = &client->speculation;
+    int branch = speculation_match(spec, frame, frame_ring_events(&client->frames, frame));
+    if (branch < 0) return false;
+
+    // The branch stops where the client was when it started, predict the rest as normal
+    client->pending_frames = 0;
+    client->sync_frame = frame;
+    frame_ring_splice(&client->frames, frame, spec->guess_state, spec->end_frame, spec->branch_heads[branch]);
+    while (client->frames.head_frame < client->client_frame) frame_ring_advance(&client->frames);
+    if (client->sync_frame == client->hash_frame) game_client_check_hash(client, spec->guess_state);
+    speculation_set_base(spec, frame, spec->guess_state);
+
+    log_printf("Speculation hit for frame %d on branch %d (%d of %d frames ready)\n", frame, branch, spec->end_frame - frame, client->client_frame - frame);
+    spec->hits++;
+    spec->frames_skipped += spec->end_frame - frame;
+    return true;
+}
+
+static void game_client_rollback_frames(GameClient *client);
+
 void game_client_reconcile_frames(GameClient *client)
 {
-    // EXPECTS state_lock to be locked
+    // Called once per tick to re-simulate over all server frames received since the last call
+    // With a reconcile_budget the re-simulation is spread over multiple ticks as a "pass"
+    // During a pass the ring head is the pass cursor and predicted_state is what gets presented
+    // With speculation a new frame matching a pre-simulated branch is swapped in instead
+    if (!client->speculate || client->pending_frames == 0)
+    {
+        game_client_rollback_frames(client);
+        return;
+    }
+
+    // Time both ways to report what a hit saves
+    Speculation *spec = &client->speculation;
+    double start_time = game_client_now();
+    bool eligible;
+    if (game_client_apply_speculation(client, &eligible))
+    {
+        spec->hit_seconds += game_client_now() - start_time;
+        return;
+    }
+
+    game_client_rollback_frames(client);
+    if (eligible)
+    {
+        spec->misses++;
+        spec->miss_seconds += game_client_now() - start_time;
+    }
+}
+
+static void game_client_rollback_frames(GameClient *client)
+{
+
+    if (client->pending_frames > 0)
+    {
+        int first_new_frame = client->server_frame - client->pending_frames + 1;
+        client->pending_frames = 0;
+
+        // Start a new pass from the last confirmed state
+        // If a pass is already past the new frames it must run again once finished
+        if (client->resim_frame < 0)
+        {
+            log_printf("Reconciling with rollback (sync %d <= server %d <= client %d)\n", client->sync_frame, client->server_frame, client->client_frame);
+            int depth = client->client_frame - client->sync_frame;
+            client->rollback_count++;
+            client->rollback_depth_sum += depth;
+            if (depth > client->rollback_depth_max) client->rollback_depth_max = depth;
+            game_state_copy(client->predicted_state, frame_ring_head(&client->frames));
+            frame_ring_rewind(&client->frames, client->sync_frame);
+            client->resim_frame = client->sync_frame;
+        }
+        else if (client->resim_frame > first_new_frame)
+        {
+            client->resim_dirty = true;
+        }
+    }
+
+    if (client->resim_frame < 0) return;
 
-    if (client->client_frame > client->server_frame || client->server_frame > client->sync_frame)
+    // Re-simulate sync_frame -> client_frame, at most reconcile_budget frames this tick
+    // Any frame simulated from the confirmed state with server events is now confirmed
+    int budget = client->reconcile_budget > 0 ? client->reconcile_budget : FRAME_BUFFER_SIZE;
+    for (; budget > 0 && client->resim_frame < client->client_frame; --budget)
     {
-        log_printf("Reconciling with rollback (sync %d <= server %d <= client %d)\n", client->sync_frame, client->server_frame, client->client_frame);
+        int i = client->resim_frame;
+        frame_ring_advance(&client->frames);
+
+        if (i == client->sync_frame && i < client->server_frame)
+        {
+            client->sync_frame = i + 1;
+            if (client->sync_frame == client->hash_frame) game_client_check_hash(client, frame_ring_head(&client->frames));
+            if (client->speculate && client->sync_frame == client->server_frame)
+            {
+                speculation_set_base(&client->speculation, client->sync_frame, frame_ring_head(&client->frames));
+            }
+        }
+        client->resim_frame = i + 1;
     }
 
-    // Reconcile from sync_frame -> server_frame with new real data
-    if (client->server_frame > client->sync_frame)
+    // Finished the pass, restart if it went past frames the server has since updated
+    if (client->resim_frame >= client->client_frame)
     {
-        for (int i = client->sync_frame; i < client->server_frame; ++i)
+        client->resim_frame = -1;
+        if (client->resim_dirty)
         {
-            GameState *current_state = &client->states[i % FRAME_BUFFER_SIZE];
-            GameEvents *current_events = &client->events[i % FRAME_BUFFER_SIZE];
-            GameState *next_state = &client->states[(i + 1) % FRAME_BUFFER_SIZE];
-            game_simulate(current_state, current_events, next_state);
+            game_state_copy(client->predicted_state, frame_ring_head(&client->frames));
+            frame_ring_rewind(&client->frames, client->sync_frame);
+            client->resim_frame = client->sync_frame;
+            client->resim_dirty = false;
         }
-        client->sync_frame = client->server_frame;
+    }
+}
+
+void game_client_check_hash(GameClient *client, const GameState *state)
+{
+    // Compare the newly confirmed state against the servers hash of it
+    uint32_t local_hash = game_state_hash(state);
+    int frame = client->hash_frame;
+    client->hash_frame = -1;
+    if (local_hash == client->hash_value) return;
+
+    log_printf("WARN: Desync at frame %d (local %08x, server %08x)\n", frame, local_hash, client->hash_value);
+    game_client_request_resync(client, frame);
+}
+
+void game_client_request_resync(GameClient *client, int frame)
+{
+    // Ask the server for its confirmed state, only one request is in flight at a time
+    if (client->resync_requested) return;
+
+    uint8_t buffer[sizeof(MessageHeader) + sizeof(P2SResyncRequestPayload)];
+    size_t msg_size = serialize_p2s_resync_request(buffer, frame, client->client_index);
+    if (game_client_send(client, buffer, msg_size) < 0)
+    {
+        log_printf("Client failed to send resync request for frame %d\n", frame);
+        atomic_store(&client->is_connected, false);
+        return;
     }
 
-    // Then from server_frame -> client_frame with local data
-    if (client->client_frame > client->server_frame)
+    client->resync_requested = true;
+    client->resync_request_time = game_client_now();
+    log_printf("Sent MSG_P2S_RESYNC_REQUEST for frame %d\n", frame);
+}
+
+void game_client_simulate_frame(GameClient *client)
+{
+    // Predict client_frame -> client_frame + 1 with the local events
+    // Outside of a pass the ring head is the prediction so it simulates straight into the ring
+    if (client->resim_frame < 0)
+    {
+        frame_ring_advance(&client->frames);
+    }
+    else
     {
-        for (int i = client->server_frame; i < client->client_frame; ++i)
+        const GameEvents *current_events = frame_ring_events(&client->frames, client->client_frame);
+        if (!game_events_idle(current_events, client->predicted_state))
         {
-            GameState *current_state = &client->states[i % FRAME_BUFFER_SIZE];
-            GameEvents *current_events = &client->events[i % FRAME_BUFFER_SIZE];
-            GameState *next_state = &client->states[(i + 1) % FRAME_BUFFER_SIZE];
-            game_simulate(current_state, current_events, next_state);
+            game_simulate(client->predicted_state, current_events, client->predicted_state);
         }
     }
+
+    // Now we can iterate to start the next frame, unless the input delay already has
+    client->client_frame++;
+    if (client->client_frame > client->input_frame) game_events_clear(frame_ring_events(&client->frames, client->client_frame));
+
+    // Give the speculation worker the newly predicted frame
+    if (client->speculate && client->resim_frame < 0)
+    {
+        speculation_start(&client->speculation, &client->frames, client->client_frame, client->client_index);
+    }
+}
+
+const GameState *game_client_predicted_state(const GameClient *client)
+{
+    if (client->resim_frame < 0) return frame_ring_head(&client->frames);
+    return client->predicted_state;
+}
+
+double game_client_tick_stretch(const GameClient *client)
+{
+    // How much longer to make the next ticks, negative for shorter, to bring the client level
+    // with the rest of the room. A client ahead of the others only makes everyone predict
+    // further and one behind holds the server up, so both are eased back a little each tick
+    double stretch = client->frame_advantage * TIME_SYNC_STRETCH_PER_FRAME;
+    if (stretch > TIME_SYNC_MAX_STRETCH) stretch = TIME_SYNC_MAX_STRETCH;
+    if (stretch < -TIME_SYNC_MAX_STRETCH) stretch = -TIME_SYNC_MAX_STRETCH;
+    return stretch;
+}
+
+void game_client_update_input_delay(GameClient *client)
+{
+    // Once per tick, before scheduling input. Steps the adaptive delay at most a frame every
+    // INPUT_DELAY_ADJUST_FRAMES towards its target, with some slack so it does not flap
+    // between two, and logs the delay and rollback depth over that time
+    if (client->client_frame < client->input_delay_frame + INPUT_DELAY_ADJUST_FRAMES) return;
+
+    RttEstimator *rtt = &client->input_rtt;
+    if (client->input_delay_mode == INPUT_DELAY_ADAPTIVE && rtt->samples > 0)
+    {
+        double target = (rtt->srtt + 2.0 * rtt->rttvar) * INPUT_DELAY_RTT_SHARE * SIMULATION_TICK_RATE;
+        if (target > client->input_delay + INPUT_DELAY_HYSTERESIS && client->input_delay < INPUT_DELAY_MAX) client->input_delay++;
+        else if (target < client->input_delay - INPUT_DELAY_HYSTERESIS && client->input_delay > 0) client->input_delay--;
+    }
+
+    double depth_mean = client->rollback_count > 0 ? (double)client->rollback_depth_sum / client->rollback_count : 0.0;
+    log_printf("Input delay %d frames at frame %d: input rtt %.1f ms (jitter %.1f ms), %d rollbacks %.1f frames deep on average, %d at most\n",
+               client->input_delay, client->client_frame, rtt->srtt * 1000.0, rtt->rttvar * 1000.0, client->rollback_count, depth_mean,
+               client->rollback_depth_max);
+    client->input_delay_frame = client->client_frame;
+    client->rollback_count = 0;
+    client->rollback_depth_sum = 0;
+    client->rollback_depth_max = 0;
+}
+
+GameEvents *game_client_schedule_input(GameClient *client)
+{
+    // Events of the next frame without a local input, for the caller to fill in and send
+    // Keep calling while input_frame < client_frame + input_delay, more than once after the
+    // delay goes up and not at all after it comes down
+    int frame = ++client->input_frame;
+    GameEvents *events = frame_ring_events(&client->frames, frame);
+    if (frame > client->client_frame) game_events_clear(events);
+    return events;
 }
 
 void game_client_send_game_events(GameClient *client, int frame, GameEvents *events)
 {
     // Serialize and send to server the players inputs
-    uint8_t buffer[MAX_MESSAGE_SIZE];
+    uint8_t buffer[sizeof(MessageHeader) + sizeof(P2SGameEventsPayload)];
     size_t msg_size = serialize_p2s_frame_inputs(
         buffer,
         frame,
         client->client_index,
-        &events->player_inputs[client->client_index]);
+        &events->players[client->client_index].input);
 
-    ssize_t sent = send(client->socket_fd, buffer, msg_size, 0);
+    ssize_t sent = game_client_send(client, buffer, msg_size);
     if (sent < 0)
     {
         log_printf("Client failed to send frame %u", frame);
@@ -236,5 +634,28 @@ void game_client_send_game_events(GameClient *client, int frame, GameEvents *eve
         return;
     }
 
+    client->input_sent_times[frame % FRAME_BUFFER_SIZE] = game_client_now();
     log_printf("Sent MSG_P2S_FRAME_INPUTS for frame %u\n", frame);
 }
+
+void game_client_send_ping(GameClient *client)
+{
+    // Answered by a MSG_PONG that the receive thread times
+    uint8_t buffer[sizeof(MessageHeader) + sizeof(PingPayload)];
+    size_t msg_size = serialize_ping(buffer, MSG_PING, client->client_frame, pacer_now_ns(), 0);
+    if (game_client_send(client, buffer, msg_size) < 0)
+    {
+        log_printf("Client failed to send MSG_PING\n");
+        atomic_store(&client->is_connected, false);
+    }
+}
+
+void game_client_rtt_stats(GameClient *client, RttStats *out_stats)
+{
+    // Round trip to the server so far, from any thread
+    pthread_mutex_lock(&client->rtt_lock);
+    {
+        rtt_estimator_stats(&client->rtt, out_stats);
+    }
+    pthread_mutex_unlock(&client->rtt_lock);
+}
@@ -1,11 +1,25 @@
 #pragma once
 
+#include "../shared/framering.h"
 #include "../shared/gameimpl.h"
+#include "../shared/messagequeue.h"
 #include "../shared/protocol.h"
+#include "../shared/rtt.h"
+#include "speculation.h"
 #include <pthread.h>
 #include <signal.h>
 #include <stdatomic.h>
 
+// Local inputs go input_delay frames ahead of the prediction so they reach everyone else
+// sooner, trading input latency for shallower rollbacks. INPUT_DELAY_FIXED holds it at
+// INPUT_DELAY_FRAMES, INPUT_DELAY_ADAPTIVE moves it a frame at a time to cover
+// INPUT_DELAY_RTT_SHARE of the round trip from sending an input to the server confirming it
+typedef enum
+{
+    INPUT_DELAY_FIXED,
+    INPUT_DELAY_ADAPTIVE,
+} InputDelayMode;
+
 typedef struct
 {
     atomic_bool to_shutdown;
@@ -13,21 +27,57 @@ typedef struct
     atomic_bool is_initialised;
 
     int socket_fd;
+    // Held for every message sent, the receive thread answers pings while the game sends inputs
+    pthread_mutex_t send_lock;
     pthread_t recv_thread;
-    pthread_mutex_t state_lock;
+    MessageQueue recv_queue;
+
+    // From pings every PING_INTERVAL_FRAMES, timed and answered on the receive thread
+    pthread_mutex_t rtt_lock;
+    RttEstimator rtt;
 
     int client_index;
     int sync_frame;
     int server_frame;
     int client_frame;
-    GameState states[FRAME_BUFFER_SIZE];
-    GameEvents events[FRAME_BUFFER_SIZE];
+    int pending_frames;
+    int reconcile_budget;
+    int resim_frame;
+    bool resim_dirty;
+    int hash_frame;
+    uint32_t hash_value;
+    bool resync_requested;
+    double resync_request_time;
+    double frame_advantage;
+    InputDelayMode input_delay_mode;
+    int input_delay;
+    int input_frame;
+    int input_delay_frame;
+    double input_sent_times[FRAME_BUFFER_SIZE];
+    RttEstimator input_rtt;
+    int rollback_count;
+    int rollback_depth_sum;
+    int rollback_depth_max;
+    FrameRing frames;
+    GameState *predicted_state;
+    bool speculate;
+    Speculation speculation;
 } GameClient;
 
 int game_client_init(GameClient *client, const char *server_ip, int port);
 void game_client_shutdown(GameClient *client);
 void *game_client_recv_thread(void *arg);
 
+void game_client_poll_messages(GameClient *client);
 void game_client_handle_payload(GameClient *client, MessageHeader *header, char *buf, size_t n);
 void game_client_reconcile_frames(GameClient *client);
+void game_client_check_hash(GameClient *client, const GameState *state);
+void game_client_request_resync(GameClient *client, int frame);
+void game_client_simulate_frame(GameClient *client);
+const GameState *game_client_predicted_state(const GameClient *client);
+double game_client_tick_stretch(const GameClient *client);
+void game_client_update_input_delay(GameClient *client);
+GameEvents *game_client_schedule_input(GameClient *client);
 void game_client_send_game_events(GameClient *client, int frame, GameEvents *events);
+void game_client_send_ping(GameClient *client);
+void game_client_rtt_stats(GameClient *client, RttStats *out_stats);
@@ -2,25 +2,35 @@
 #include "gameimpl.h"
 #include "raylib.h"
 
-void game_handle_events(GameState *game_state, GameEvents *game_events, int client_index)
+unsigned int game_sample_input(void)
+{
+    // Movement keys held right now, bit i is movements_held[i]
+    return (unsigned int)IsKeyDown(KEY_A) | (unsigned int)IsKeyDown(KEY_D) << 1 | (unsigned int)IsKeyDown(KEY_W) << 2 | (unsigned int)IsKeyDown(KEY_S) << 3;
+}
+
+void game_handle_events(const GameState *game_state, GameEvents *game_events, int client_index, unsigned int input)
 {
     // Otherwise handle moving the player
-    PlayerInput *controls = &game_events->player_inputs[client_index];
-    controls->movements_held[0] = IsKeyDown(KEY_A);
-    controls->movements_held[1] = IsKeyDown(KEY_D);
-    controls->movements_held[3] = IsKeyDown(KEY_S);
-    controls->movements_held[2] = IsKeyDown(KEY_W);
+    PlayerInput *controls = &game_events->players[client_index].input;
+    for (int i = 0; i < 4; ++i) controls->movements_held[i] = (input >> i) & 1;
 }
 
-void game_render(const GameState *game_state, int client_index)
+void game_render(const GameState *previous, const GameState *current, float alpha, int client_index)
 {
-    // Render each player as a coloured circle
-    for (size_t i = 0; i < MAX_CLIENTS; ++i)
+    // Render each active player as a coloured circle, alpha of the way from previous to current
+    // Players that were not in the previous state are drawn where they are now
+    const uint16_t *slots = game_state_active_slots(current);
+    for (int k = 0; k < current->active_count; ++k)
     {
-        const PlayerData *player = &game_state->player_data[i];
-        if (player->active)
+        int i = slots[k];
+        const PlayerData *player = &current->player_data[i];
+        float x = GAME_POS_TO_FLOAT(player->x);
+        float y = GAME_POS_TO_FLOAT(player->y);
+        if (previous->player_data[i].active)
         {
-            DrawCircle((int)player->x, (int)player->y, 20, (i == client_index) ? BLUE : RED);
+            x += (GAME_POS_TO_FLOAT(previous->player_data[i].x) - x) * (1.0f - alpha);
+            y += (GAME_POS_TO_FLOAT(previous->player_data[i].y) - y) * (1.0f - alpha);
         }
+        DrawCircle((int)x, (int)y, GAME_POS_TO_FLOAT(PLAYER_RADIUS), (i == client_index) ? BLUE : RED);
     }
 }
@@ -2,6 +2,7 @@
 
 #include "../shared/gameimpl.h"
 
-void game_handle_events(GameState *game_state, GameEvents *game_events, int client_index);
+unsigned int game_sample_input(void);
+void game_handle_events(const GameState *game_state, GameEvents *game_events, int client_index, unsigned int input);
 
-void game_render(const GameState *game_state, int client_index);
+void game_render(const GameState *previous, const GameState *current, float alpha, int client_index);
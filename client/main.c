@@ -1,18 +1,22 @@
 // cbuild: -I../libs/raylib/include -L../libs/raylib/lib -I../
-// cbuild: -lraylib -lm ../shared/gameimpl.c ../shared/protocol.c ../shared/log.c gameimpl.c gameclient.c
+// cbuild: ../shared/gameimpl.c ../shared/spatialhash.c ../shared/protocol.c ../shared/log.c ../shared/messagequeue.c ../shared/framering.c ../shared/pacer.c ../shared/rtt.c gameimpl.c gameclient.c speculation.c statehandoff.c -lraylib -lm
 
 #include "../shared/gameimpl.h"
 #include "../shared/globals.h"
 #include "../shared/log.h"
+#include "../shared/pacer.h"
 #include "gameclient.h"
 #include "gameimpl.h"
 #include "raylib.h"
+#include "statehandoff.h"
 #include <arpa/inet.h>
+#include <pthread.h>
 #include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <time.h>
 #include <unistd.h>
 
 volatile sig_atomic_t to_shutdown_app = 0;
@@ -34,6 +38,102 @@ void init_sigaction_handler(struct sigaction *sa)
     sigaction(SIGTERM, sa, NULL);
 }
 
+// The simulation runs on its own thread at SIMULATION_TICK_RATE and the main thread, which
+// raylib needs for the window and input, draws at the display rate between the last two
+// predicted states. Inputs go over as key bits, pressed accumulates everything held since the
+// last tick so a tap shorter than a tick still counts
+typedef struct
+{
+    GameClient *client;
+    pthread_t thread;
+    atomic_bool running;
+    atomic_bool ready;
+    atomic_uint input_held;
+    atomic_uint input_pressed;
+    StateHandoff handoff;
+} Simulation;
+
+static double app_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void simulation_tick(Simulation *sim)
+{
+    GameClient *client = sim->client;
+
+    // Apply everything the receive thread has queued up at the start of the tick
+    game_client_poll_messages(client);
+
+    if (!atomic_load_explicit(&client->is_initialised, memory_order_acquire)) return;
+
+    // The capacity is only known once initialised
+    if (!atomic_load_explicit(&sim->ready, memory_order_relaxed))
+    {
+        if (state_handoff_init(&sim->handoff, client->frames.capacity) != 0)
+        {
+            atomic_store(&client->is_connected, false);
+            return;
+        }
+        atomic_store_explicit(&sim->ready, true, memory_order_release);
+    }
+
+    // Reconcile once against all server frames that arrived since the last tick
+    // This may only partially re-simulate if the client has a reconcile budget
+    game_client_reconcile_frames(client);
+
+    game_client_update_input_delay(client);
+
+    // Client is too far ahead of the last confirmed frame to keep predicting so hold this tick
+    // Time sync keeps clients well clear of this so it is only reached once the server stops
+    // confirming frames altogether, if it has confirmed past it ask to be resynced forward
+    if (client->client_frame + client->input_delay >= frame_ring_window_end(&client->frames, client->sync_frame))
+    {
+        log_printf("WARN: Client frame %u reached further than buffer size %d from sync frame %u\n", client->client_frame, FRAME_BUFFER_SIZE, client->sync_frame);
+        if (client->server_frame > client->sync_frame) game_client_request_resync(client, client->sync_frame);
+    }
+    else
+    {
+        // Read in local events input_delay frames ahead and send them to the server
+        // Input is only taken when a frame needs it so nothing pressed is lost when the delay drops
+        while (client->input_frame < client->client_frame + client->input_delay)
+        {
+            GameEvents *input_events = game_client_schedule_input(client);
+            unsigned int input = atomic_exchange(&sim->input_pressed, 0) | atomic_load(&sim->input_held);
+            game_handle_events(game_client_predicted_state(client), input_events, client->client_index, input);
+            game_client_send_game_events(client, client->input_frame, input_events);
+        }
+
+        // Simulate another frame
+        log_printf("Client simulating frame %u\n", client->client_frame);
+        game_client_simulate_frame(client);
+        if (client->client_frame % PING_INTERVAL_FRAMES == 0) game_client_send_ping(client);
+    }
+
+    // Hand the new prediction to the renderer, also when held since reconciling may have moved it
+    state_handoff_publish(&sim->handoff, game_client_predicted_state(client), client->client_frame, app_now());
+}
+
+static void *simulation_thread(void *arg)
+{
+    Simulation *sim = (Simulation *)arg;
+    Pacer pacer;
+    pacer_init(&pacer, SIMULATION_TICK_RATE, SIMULATION_SPIN_NS);
+    while (atomic_load(&sim->running) && atomic_load(&sim->client->is_connected))
+    {
+        simulation_tick(sim);
+        pacer_set_stretch(&pacer, game_client_tick_stretch(sim->client));
+        pacer_wait(&pacer);
+    }
+
+    pacer_log_stats(&pacer, "Simulation pacing");
+    log_printf("Simulation frame advantage %.2f, tick stretch %.1f%%\n", sim->client->frame_advantage, game_client_tick_stretch(sim->client) * 100.0);
+    log_printf("Client simulation thread shutdown\n");
+    return NULL;
+}
+
 int main()
 {
     log_printf("Client application started\n");
@@ -42,8 +142,9 @@ int main()
     init_sigaction_handler(&sa);
 
     SetTraceLogLevel(LOG_WARNING);
-    SetTargetFPS(SIMULATION_TICK_RATE);
     InitWindow(800, 800, "Raylib Netcode");
+    int refresh_rate = GetMonitorRefreshRate(GetCurrentMonitor());
+    SetTargetFPS(refresh_rate > 0 ? refresh_rate : RENDER_DEFAULT_FPS);
 
     GameClient client;
     if (game_client_init(&client, "127.0.0.1", PORT) != 0)
@@ -53,66 +154,46 @@ int main()
         return 1;
     }
 
-    while (!WindowShouldClose() && !to_shutdown_app && atomic_load(&client.is_connected))
+    Simulation sim = {0};
+    sim.client = &client;
+    atomic_init(&sim.running, true);
+    atomic_init(&sim.ready, false);
+    atomic_init(&sim.input_held, 0);
+    atomic_init(&sim.input_pressed, 0);
+    if (pthread_create(&sim.thread, NULL, simulation_thread, &sim) != 0)
     {
-        // int key = GetKeyPressed();
-        // if (key == 0)
-        // {
-        //     BeginDrawing();
-        //     ClearBackground(RAYWHITE);
-        //     EndDrawing();
-        //     continue;
-        // }
-        // log_printf("Key: %d\n", key);
-
-        if (!atomic_load_explicit(&client.is_initialised, memory_order_acquire)) continue;
-
-        // Do the main simulation in a tight lock to allow receiving data
-        GameState next_state_copy;
-        GameEvents current_events_copy;
-        pthread_mutex_lock(&client.state_lock);
-        {
-            // Error state if client is too far ahead of server
-            if (client.client_frame >= client.sync_frame + FRAME_BUFFER_SIZE - 1)
-            {
-                log_printf("WARN: Client frame %u reached further than buffer size %d from sync frame %u", client.client_frame, FRAME_BUFFER_SIZE, client.sync_frame);
-                usleep(1000 * 1000);
-                pthread_mutex_unlock(&client.state_lock);
-                continue;
-            }
-
-            // Read in local events and simulate another frame
-            GameState *current_state = &client.states[client.client_frame % FRAME_BUFFER_SIZE];
-            GameEvents *current_events = &client.events[client.client_frame % FRAME_BUFFER_SIZE];
-            GameState *next_state = &client.states[(client.client_frame + 1) % FRAME_BUFFER_SIZE];
-
-            log_printf("Client simulating frame %u\n", client.client_frame);
-            game_handle_events(current_state, current_events, client.client_index);
-            game_simulate(current_state, current_events, next_state);
-
-            // Copy immutable state and events
-            next_state_copy = *next_state;
-            current_events_copy = *current_events;
-
-            // Now we can iterate to start the next frame
-            client.client_frame++;
-            GameEvents *next_events = &client.events[client.client_frame % FRAME_BUFFER_SIZE];
-            memset(next_events, 0, sizeof(GameEvents));
-        }
-        pthread_mutex_unlock(&client.state_lock);
+        perror("pthread_create()");
+        game_client_shutdown(&client);
+        CloseWindow();
+        return 1;
+    }
 
-        // Send the local events to the server
-        game_client_send_game_events(&client, client.client_frame - 1, &current_events_copy);
+    while (!WindowShouldClose() && !to_shutdown_app && atomic_load(&client.is_connected))
+    {
+        unsigned int input = game_sample_input();
+        atomic_store(&sim.input_held, input);
+        atomic_fetch_or(&sim.input_pressed, input);
 
-        // Render the new generated frame
         BeginDrawing();
         ClearBackground(RAYWHITE);
-        game_render(&next_state_copy, client.client_index);
+        const StateSnapshot *snapshot = NULL;
+        if (atomic_load_explicit(&sim.ready, memory_order_acquire)) snapshot = state_handoff_latest(&sim.handoff);
+        if (snapshot != NULL)
+        {
+            // Drawn a tick behind, moving from the previous state to the current one over
+            // the tick after the current one was published
+            float alpha = (float)((app_now() - snapshot->time) * SIMULATION_TICK_RATE);
+            if (alpha > 1.0f) alpha = 1.0f;
+            game_render(snapshot->previous, snapshot->current, alpha, client.client_index);
+        }
         DrawFPS(10, 10);
         EndDrawing();
     }
 
     log_printf("Shutting down the game client\n");
+    atomic_store(&sim.running, false);
+    pthread_join(sim.thread, NULL);
+    if (atomic_load(&sim.ready)) state_handoff_free(&sim.handoff);
     game_client_shutdown(&client);
     CloseWindow();
     return 0;
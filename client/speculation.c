@@ -0,0 +1,218 @@
+#include "speculation.h"
+#include "../shared/log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static GameEvents *speculation_events(const Speculation *spec, int frame)
+{
+    return (GameEvents *)(spec->events + (frame % FRAME_BUFFER_SIZE) * spec->events_size);
+}
+
+static void speculation_run(Speculation *spec)
+{
+    // A new base simulates the confirmed frame once for every branch, then each branch
+    // simulates from the guess frame, or from where the last job left it, up to end_frame
+    int guess_frame = spec->base_frame + 1;
+    int from_frame = spec->from_frame;
+    if (from_frame == spec->base_frame)
+    {
+        game_simulate(spec->base_state, speculation_events(spec, spec->base_frame), spec->guess_state);
+        for (int b = 0; b < SPECULATION_BRANCH_COUNT; ++b) game_state_copy(spec->branch_heads[b], spec->guess_state);
+        from_frame = guess_frame;
+    }
+
+    for (int b = 0; b < SPECULATION_BRANCH_COUNT; ++b)
+    {
+        GameState *head = spec->branch_heads[b];
+        for (int frame = from_frame; frame < spec->end_frame; ++frame)
+        {
+            const GameEvents *events = frame == guess_frame ? spec->branch_events[b] : speculation_events(spec, frame);
+            if (!game_events_idle(events, head)) game_simulate(head, events, head);
+        }
+    }
+}
+
+static void *speculation_thread(void *arg)
+{
+    Speculation *spec = (Speculation *)arg;
+
+    pthread_mutex_lock(&spec->lock);
+    while (true)
+    {
+        while (!spec->to_shutdown && !spec->busy) pthread_cond_wait(&spec->cond, &spec->lock);
+        if (spec->to_shutdown) break;
+        pthread_mutex_unlock(&spec->lock);
+
+        speculation_run(spec);
+
+        pthread_mutex_lock(&spec->lock);
+        spec->busy = false;
+        spec->ready = true;
+    }
+    pthread_mutex_unlock(&spec->lock);
+    return NULL;
+}
+
+int speculation_init(Speculation *spec, int capacity)
+{
+    memset(spec, 0, sizeof(*spec));
+    pthread_mutex_init(&spec->lock, NULL);
+    pthread_cond_init(&spec->cond, NULL);
+    spec->capacity = capacity;
+    spec->next_base_frame = -1;
+    spec->events_size = game_events_size(capacity);
+    spec->events = malloc(FRAME_BUFFER_SIZE * spec->events_size);
+    spec->base_state = game_state_alloc(capacity);
+    spec->guess_state = game_state_alloc(capacity);
+    spec->next_base_state = game_state_alloc(capacity);
+    bool allocated = spec->events && spec->base_state && spec->guess_state && spec->next_base_state;
+    for (int b = 0; b < SPECULATION_BRANCH_COUNT; ++b)
+    {
+        spec->branch_events[b] = game_events_alloc(capacity);
+        spec->branch_heads[b] = game_state_alloc(capacity);
+        allocated &= spec->branch_events[b] != NULL && spec->branch_heads[b] != NULL;
+    }
+    if (!allocated)
+    {
+        perror("malloc()");
+        speculation_free(spec);
+        return 1;
+    }
+
+    if (pthread_create(&spec->thread, NULL, speculation_thread, spec) != 0)
+    {
+        perror("pthread_create() speculation_thread");
+        spec->thread = 0;
+        speculation_free(spec);
+        return 1;
+    }
+    return 0;
+}
+
+void speculation_free(Speculation *spec)
+{
+    if (spec->thread)
+    {
+        pthread_mutex_lock(&spec->lock);
+        spec->to_shutdown = true;
+        pthread_cond_signal(&spec->cond);
+        pthread_mutex_unlock(&spec->lock);
+        pthread_join(spec->thread, NULL);
+        spec->thread = 0;
+    }
+
+    pthread_mutex_destroy(&spec->lock);
+    pthread_cond_destroy(&spec->cond);
+    free(spec->events);
+    free(spec->base_state);
+    free(spec->guess_state);
+    free(spec->next_base_state);
+    for (int b = 0; b < SPECULATION_BRANCH_COUNT; ++b)
+    {
+        free(spec->branch_events[b]);
+        free(spec->branch_heads[b]);
+    }
+    memset(spec, 0, sizeof(*spec));
+}
+
+void speculation_set_base(Speculation *spec, int frame, const GameState *state)
+{
+    // Newest confirmed state, picked up by the next job that starts
+    spec->next_base_frame = frame;
+    game_state_copy(spec->next_base_state, state);
+}
+
+void speculation_start(Speculation *spec, FrameRing *ring, int end_frame, int local_index)
+{
+    // Hand the worker everything new since its last job, if it is not still busy with that one
+    // Needs the events of the guess frame to be final locally so end_frame has to be past it
+    pthread_mutex_lock(&spec->lock);
+    int base_frame = spec->next_base_frame;
+    if (spec->busy || base_frame < 0 || end_frame <= base_frame + 1)
+    {
+        pthread_mutex_unlock(&spec->lock);
+        return;
+    }
+
+    bool extend = spec->ready && spec->job_epoch == spec->epoch && spec->base_frame == base_frame;
+    if (extend && end_frame <= spec->end_frame)
+    {
+        pthread_mutex_unlock(&spec->lock);
+        return;
+    }
+
+    if (extend)
+    {
+        spec->from_frame = spec->end_frame;
+    }
+    else
+    {
+        // Guess the guess frames remote inputs from the confirmed base frame
+        spec->base_frame = base_frame;
+        spec->from_frame = base_frame;
+        spec->job_epoch = spec->epoch;
+        game_state_copy(spec->base_state, spec->next_base_state);
+
+        const GameEvents *confirmed = frame_ring_events(ring, base_frame);
+        const GameEvents *predicted = frame_ring_events(ring, base_frame + 1);
+        for (int b = 0; b < SPECULATION_BRANCH_COUNT; ++b)
+        {
+            GameEvents *guess = spec->branch_events[b];
+            game_events_clear(guess);
+            guess->players[local_index] = predicted->players[local_index];
+            guess->event_count = predicted->players[local_index].event != PLAYER_EVENT_NONE;
+            for (int i = 0; b == SPECULATION_HOLD && i < spec->capacity; ++i)
+            {
+                if (i != local_index) guess->players[i].input = confirmed->players[i].input;
+            }
+        }
+        spec->attempts++;
+    }
+
+    for (int frame = spec->from_frame; frame < end_frame; ++frame)
+    {
+        game_events_copy(speculation_events(spec, frame), frame_ring_events(ring, frame));
+    }
+    spec->end_frame = end_frame;
+    spec->ready = false;
+    spec->busy = true;
+    pthread_cond_signal(&spec->cond);
+    pthread_mutex_unlock(&spec->lock);
+}
+
+void speculation_invalidate(Speculation *spec)
+{
+    // Anything simulated so far, or still being simulated, is from states that no longer hold
+    spec->epoch++;
+    spec->next_base_frame = -1;
+}
+
+int speculation_match(Speculation *spec, int guess_frame, const GameEvents *events)
+{
+    // Branch whose guess matches the servers events for guess_frame, or -1
+    // Once this returns a branch its states stay untouched until the next speculation_start()
+    pthread_mutex_lock(&spec->lock);
+    bool busy = spec->busy;
+    bool valid = spec->ready && spec->job_epoch == spec->epoch && spec->base_frame + 1 == guess_frame;
+    pthread_mutex_unlock(&spec->lock);
+
+    if (busy) spec->late++;
+    if (!valid) return -1;
+    for (int b = 0; b < SPECULATION_BRANCH_COUNT; ++b)
+    {
+        if (game_events_match(spec->branch_events[b], events, spec->guess_state)) return b;
+    }
+    return -1;
+}
+
+void speculation_log_stats(const Speculation *spec)
+{
+    if (spec->attempts == 0) return;
+    double hit_rate = 100.0 * spec->hits / (spec->hits + spec->misses > 0 ? spec->hits + spec->misses : 1);
+    double hit_ms = spec->hits > 0 ? spec->hit_seconds * 1000.0 / spec->hits : 0.0;
+    double miss_ms = spec->misses > 0 ? spec->miss_seconds * 1000.0 / spec->misses : 0.0;
+    log_printf("Speculation: %d hits, %d misses (%.1f%% hit rate), %d late, %d frames not re-simulated\n",
+               spec->hits, spec->misses, hit_rate, spec->late, spec->frames_skipped);
+    log_printf("Speculation: reconcile %.3f ms on a hit, %.3f ms on a miss\n", hit_ms, miss_ms);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "../shared/framering.h"
+#include "../shared/gameimpl.h"
+#include <pthread.h>
+#include <stdbool.h>
+
+// Speculative re-simulation of the predicted frames on a spare core
+//
+// After the client is fully reconciled the confirmed state at sync_frame is handed to a worker
+// thread along with the events up to client_frame. The servers events for the next frame,
+// guess_frame, are guessed once per branch and the worker simulates every branch up to the
+// client frame. Later frames use the same predicted events as the main line so when the real
+// events for guess_frame arrive and match a branch, its states can be spliced into the ring
+// in place of rolling back. As the client keeps predicting the branches are extended rather
+// than started again.
+
+typedef enum
+{
+    SPECULATION_HOLD,    // Remote players keep holding their last confirmed keys
+    SPECULATION_RELEASE, // Remote players let go of everything, same as the main line prediction
+    SPECULATION_BRANCH_COUNT,
+} SpeculationBranch;
+
+typedef struct
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool to_shutdown;
+    bool busy;
+    bool ready;
+
+    // Owned by the worker while busy
+    int capacity;
+    int base_frame;
+    int from_frame;
+    int end_frame;
+    size_t events_size;
+    uint8_t *events;
+    GameState *base_state;
+    GameState *guess_state;
+    GameEvents *branch_events[SPECULATION_BRANCH_COUNT];
+    GameState *branch_heads[SPECULATION_BRANCH_COUNT];
+
+    // Owned by the main thread, the next base state and a counter to tell stale jobs apart
+    int next_base_frame;
+    GameState *next_base_state;
+    int epoch;
+    int job_epoch;
+
+    int attempts;
+    int hits;
+    int late;
+    int frames_skipped;
+    double hit_seconds;
+    double miss_seconds;
+    int misses;
+} Speculation;
+
+int speculation_init(Speculation *spec, int capacity);
+void speculation_free(Speculation *spec);
+
+void speculation_set_base(Speculation *spec, int frame, const GameState *state);
+void speculation_start(Speculation *spec, FrameRing *ring, int end_frame, int local_index);
+void speculation_invalidate(Speculation *spec);
+int speculation_match(Speculation *spec, int guess_frame, const GameEvents *events);
+void speculation_log_stats(const Speculation *spec);
@@ -0,0 +1,77 @@
+#include "statehandoff.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define STATE_HANDOFF_FRESH 4u
+#define STATE_HANDOFF_INDEX 3u
+
+int state_handoff_init(StateHandoff *handoff, int capacity)
+{
+    atomic_init(&handoff->middle, 1);
+    handoff->back = 0;
+    handoff->front = 2;
+    handoff->capacity = capacity;
+    handoff->published = false;
+    handoff->last = game_state_alloc(capacity);
+    bool allocated = handoff->last != NULL;
+    for (int i = 0; i < 3; ++i)
+    {
+        StateSnapshot *slot = &handoff->slots[i];
+        slot->frame = -1;
+        slot->time = 0.0;
+        slot->previous = game_state_alloc(capacity);
+        slot->current = game_state_alloc(capacity);
+        allocated = allocated && slot->previous != NULL && slot->current != NULL;
+    }
+    if (!allocated)
+    {
+        perror("malloc()");
+        state_handoff_free(handoff);
+        return 1;
+    }
+    return 0;
+}
+
+void state_handoff_free(StateHandoff *handoff)
+{
+    free(handoff->last);
+    handoff->last = NULL;
+    for (int i = 0; i < 3; ++i)
+    {
+        free(handoff->slots[i].previous);
+        free(handoff->slots[i].current);
+        handoff->slots[i].previous = NULL;
+        handoff->slots[i].current = NULL;
+    }
+}
+
+void state_handoff_publish(StateHandoff *handoff, const GameState *state, int frame, double time)
+{
+    // PUBLISHER ONLY: the last published state becomes the previous one and state the current one
+    // The first publish uses state for both so there is never an empty state to interpolate from
+    StateSnapshot *slot = &handoff->slots[handoff->back];
+    game_state_copy(slot->previous, handoff->published ? handoff->last : state);
+    game_state_copy(slot->current, state);
+    game_state_copy(handoff->last, state);
+    slot->frame = frame;
+    slot->time = time;
+    handoff->published = true;
+
+    // The slot given back is either the readers old front or a snapshot it never took
+    unsigned int middle = atomic_exchange_explicit(&handoff->middle, (unsigned int)handoff->back | STATE_HANDOFF_FRESH, memory_order_acq_rel);
+    handoff->back = (int)(middle & STATE_HANDOFF_INDEX);
+}
+
+const StateSnapshot *state_handoff_latest(StateHandoff *handoff)
+{
+    // READER ONLY: the newest published snapshot, NULL until the first publish
+    // It stays the readers own and unchanged until the next call
+    if (atomic_load_explicit(&handoff->middle, memory_order_relaxed) & STATE_HANDOFF_FRESH)
+    {
+        unsigned int middle = atomic_exchange_explicit(&handoff->middle, (unsigned int)handoff->front, memory_order_acq_rel);
+        handoff->front = (int)(middle & STATE_HANDOFF_INDEX);
+    }
+
+    const StateSnapshot *slot = &handoff->slots[handoff->front];
+    return slot->frame >= 0 ? slot : NULL;
+}
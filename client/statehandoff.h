@@ -0,0 +1,41 @@
+#pragma once
+
+#include "../shared/gameimpl.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Hands the last two predicted states from the simulation thread to the render thread
+//
+// A triple buffer of snapshots. The simulation fills the back slot and swaps it with the
+// middle one, the renderer swaps its front slot with the middle one when there is something
+// newer and then draws straight from it. Each side only ever touches its own slot, so neither
+// waits for or copies anything on behalf of the other, and however long the simulation takes
+// the renderer always has a whole snapshot to draw.
+// Only one thread publishes and only one reads
+
+typedef struct
+{
+    int frame;
+    double time;
+    GameState *previous;
+    GameState *current;
+} StateSnapshot;
+
+typedef struct
+{
+    // Index of the middle slot, flagged while it holds a snapshot the reader has not taken
+    // back, published and last are the publishers own and front the readers
+    atomic_uint middle;
+    int back;
+    int front;
+    int capacity;
+    bool published;
+    GameState *last;
+    StateSnapshot slots[3];
+} StateHandoff;
+
+int state_handoff_init(StateHandoff *handoff, int capacity);
+void state_handoff_free(StateHandoff *handoff);
+
+void state_handoff_publish(StateHandoff *handoff, const GameState *state, int frame, double time);
+const StateSnapshot *state_handoff_latest(StateHandoff *handoff);
@@ -0,0 +1,2 @@
+#!/bin/bash
+./cbuild.sh ./bench/main.c -silent -output ./build/bench -run
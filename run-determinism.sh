@@ -0,0 +1,21 @@
+#!/bin/bash
+# Build the determinism replay with different flags and check every build agrees
+# Each numeric mode is compared only against itself, fixed and float never match
+flags=$(sed -n 's#^// cbuild: ##p' ./bench/main.c | tr '\n' ' ')
+variants=("-O0" "-O2" "-O3 -march=native -ffp-contract=fast" "-O2 -ffast-math")
+status=0
+mkdir -p ./build
+for mode in 1 0; do
+    hashes=""
+    for variant in "${variants[@]}"; do
+        (cd ./bench && gcc main.c -o ../build/determinism $flags $variant -DGAME_FIXED_POINT=$mode) || exit 1
+        result=$(./build/determinism determinism | grep -E "^(fixed|float)")
+        echo "$result   ($variant)"
+        hashes+="$(echo "$result" | awk '{print $NF}')"$'\n'
+    done
+    if [[ $(echo -n "$hashes" | sort -u | wc -l) -ne 1 ]]; then
+        echo "[error] Builds disagree for GAME_FIXED_POINT=$mode"
+        status=1
+    fi
+done
+exit $status
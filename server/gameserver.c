@@ -2,10 +2,12 @@
 #include "../shared/gameimpl.h"
 #include "../shared/globals.h"
 #include "../shared/log.h"
+#include "../shared/pacer.h"
 #include "../shared/protocol.h"
 #include <arpa/inet.h>
 #include <assert.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <pthread.h>
 #include <stdatomic.h>
 #include <stdint.h>
@@ -14,7 +16,7 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
-int game_server_init(GameServer *server, int port)
+int game_server_init(GameServer *server, int port, int max_clients)
 {
     // Initialize game server state
     atomic_init(&server->to_shutdown, 0);
@@ -26,11 +28,39 @@ int game_server_init(GameServer *server, int port)
     pthread_mutex_init(&server->state_lock, NULL);
     pthread_cond_init(&server->simulation_loop_cond, NULL);
 
+    server->max_clients = max_clients;
     server->client_count = 0;
+    server->free_count = max_clients;
     server->server_frame = 0;
-    memset(server->client_data, 0, sizeof(server->client_data));
-    memset(server->game_states, 0, sizeof(server->game_states));
-    memset(server->game_events, 0, sizeof(server->game_events));
+    server->client_data = calloc(max_clients, sizeof(ClientData));
+    server->free_slots = malloc(max_clients * sizeof(int));
+    server->connected_slots = malloc(max_clients * sizeof(int));
+    if (server->client_data == NULL || server->free_slots == NULL || server->connected_slots == NULL)
+    {
+        perror("malloc()");
+        return 1;
+    }
+
+    // Hand out the lowest slots first
+    for (int i = 0; i < max_clients; ++i) server->free_slots[i] = max_clients - 1 - i;
+    for (int i = 0; i < max_clients; ++i) pthread_mutex_init(&server->client_data[i].send_lock, NULL);
+
+    if (frame_ring_init(&server->frames, max_clients, STATE_HISTORY_MODE, STATE_CHECKPOINT_INTERVAL) != 0)
+    {
+        return 1;
+    }
+
+    server->view_state = game_state_alloc(max_clients);
+    server->view_events = game_events_alloc(max_clients);
+    if (server->view_state == NULL || server->view_events == NULL)
+    {
+        perror("malloc()");
+        return 1;
+    }
+    if (interest_init(&server->interest, max_clients) != 0)
+    {
+        return 1;
+    }
 
     // Create listening socket on localhost:PORT
     server->socket_fd = socket(AF_INET, SOCK_STREAM, 0);
@@ -95,17 +125,21 @@ void game_server_shutdown(GameServer *server)
         close(server->socket_fd);
         server->socket_fd = -1;
     }
-    if (server->client_count > 0)
+
+    // Client threads remove themselves from the connected list as they exit
+    // so take a copy of the threads to wait for while closing their sockets
+    int thread_count = 0;
+    pthread_t *client_threads = malloc(server->max_clients * sizeof(pthread_t));
+    pthread_mutex_lock(&server->clients_lock);
     {
-        for (int i = 0; i < MAX_CLIENTS; ++i)
+        for (int i = 0; i < server->client_count; ++i)
         {
-            if (server->client_data[i].is_connected)
-            {
-                shutdown(server->client_data[i].fd, SHUT_RDWR);
-                close(server->client_data[i].fd);
-            }
+            ClientData *client_data = &server->client_data[server->connected_slots[i]];
+            shutdown(client_data->fd, SHUT_RDWR);
+            if (client_threads != NULL) client_threads[thread_count++] = client_data->thread_id;
         }
     }
+    pthread_mutex_unlock(&server->clients_lock);
 
     pthread_cond_signal(&server->simulation_loop_cond);
 
@@ -120,24 +154,26 @@ void game_server_shutdown(GameServer *server)
         log_printf("Waiting for client accept loop\n");
         pthread_join(server->client_accept_thread, NULL);
     }
-    if (server->client_count > 0)
+    for (int i = 0; i < thread_count; ++i)
     {
-        for (int i = 0; i < MAX_CLIENTS; ++i)
-        {
-            if (server->client_data[i].is_connected)
-            {
-                log_printf("Waiting for client %d\n", i);
-                pthread_join(server->client_data[i].thread_id, NULL);
-                server->client_data[i].fd = -1;
-                server->client_data[i].is_connected = false;
-            }
-        }
+        log_printf("Waiting for client thread %lu\n", client_threads[i]);
+        pthread_join(client_threads[i], NULL);
     }
+    free(client_threads);
 
     // Finally cleanup open client sockets
     pthread_mutex_destroy(&server->clients_lock);
     pthread_mutex_destroy(&server->state_lock);
     pthread_cond_destroy(&server->simulation_loop_cond);
+    frame_ring_free(&server->frames);
+    interest_free(&server->interest);
+    free(server->view_state);
+    free(server->view_events);
+    for (int i = 0; i < server->max_clients; ++i) interest_set_free(&server->client_data[i].interest);
+    for (int i = 0; i < server->max_clients; ++i) pthread_mutex_destroy(&server->client_data[i].send_lock);
+    free(server->client_data);
+    free(server->free_slots);
+    free(server->connected_slots);
 
     log_printf("Game server shutdown\n");
 }
@@ -161,38 +197,24 @@ void *game_server_accept_thread(void *arg)
             continue;
         }
 
+        // Every message is small and wanted straight away, do not hold them back to coalesce
+        int nodelay = 1;
+        if (setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) != 0) log_printf("Failed to set TCP_NODELAY on fd %d\n", client_fd);
+
         pthread_mutex_lock(&server->clients_lock);
         {
-            // Do not allow more than MAX_CLIENTS clients
-            if (server->client_count >= MAX_CLIENTS)
+            // Do not allow more than max_clients clients
+            if (server->free_count == 0)
             {
-                log_printf("Maximum client limit reached (%d), rejecting connection (fd=%d)\n", MAX_CLIENTS, client_fd);
+                log_printf("Maximum client limit reached (%d), rejecting connection (fd=%d)\n", server->max_clients, client_fd);
                 close(client_fd);
                 pthread_mutex_unlock(&server->clients_lock);
                 continue;
             }
 
-            // Find first available slot
-            ClientData *client_data = NULL;
-            int client_index = -1;
-            for (int i = 0; i < MAX_CLIENTS; ++i)
-            {
-                if (!server->client_data[i].is_connected)
-                {
-                    client_data = &server->client_data[i];
-                    client_index = i;
-                    pthread_mutex_unlock(&server->clients_lock);
-                    break;
-                }
-            }
-
-            // If no slot was available then reject the client
-            if (client_data == NULL)
-            {
-                log_printf("No available client slots, rejecting connection (fd=%d)\n", client_fd);
-                close(client_fd);
-                continue;
-            }
+            // Take the next free slot
+            int client_index = server->free_slots[--server->free_count];
+            ClientData *client_data = &server->client_data[client_index];
 
             // Assign to slot and initialise
             // Frame = -1 means we have received nothing for them
@@ -200,7 +222,8 @@ void *game_server_accept_thread(void *arg)
             client_data->fd = client_fd;
             client_data->index = client_index;
             client_data->client_frame = -1;
-            server->client_count++;
+            rtt_estimator_init(&client_data->rtt);
+            server->connected_slots[server->client_count++] = client_index;
 
             // Start the thread to listen to the client
             ClientThreadArgs *args = malloc(sizeof(ClientThreadArgs));
@@ -213,6 +236,7 @@ void *game_server_accept_thread(void *arg)
                 client_data->fd = -1;
                 client_data->index = -1;
                 server->client_count--;
+                server->free_slots[server->free_count++] = client_index;
                 pthread_mutex_unlock(&server->clients_lock);
                 close(client_fd);
                 free(args);
@@ -230,6 +254,18 @@ void *game_server_accept_thread(void *arg)
     return NULL;
 }
 
+static ssize_t game_server_send(ClientData *client_data, const uint8_t *buffer, size_t msg_size)
+{
+    // Every send to a client goes through here so messages from different threads never interleave
+    ssize_t sent;
+    pthread_mutex_lock(&client_data->send_lock);
+    {
+        sent = send_message(client_data->fd, buffer, msg_size);
+    }
+    pthread_mutex_unlock(&client_data->send_lock);
+    return sent;
+}
+
 void *game_server_client_thread(void *arg)
 {
     ClientThreadArgs *args = (ClientThreadArgs *)arg;
@@ -242,22 +278,29 @@ void *game_server_client_thread(void *arg)
 
     uint8_t msg_buffer[MAX_MESSAGE_SIZE];
     size_t msg_size;
+    ssize_t sent;
 
+    // Sent under the state lock like a resync so no frame can reach the client before it
     pthread_mutex_lock(&server->state_lock);
     {
-        GameEvents *current_events = &server->game_events[server->server_frame % FRAME_BUFFER_SIZE];
-        GameState *current_state = &server->game_states[server->server_frame % FRAME_BUFFER_SIZE];
+        GameEvents *current_events = frame_ring_events(&server->frames, server->server_frame);
+        const GameState *current_state = frame_ring_head(&server->frames);
 
         // Update server events with the new player
-        current_events->player_events[client_index] = PLAYER_EVENT_JOIN;
+        game_events_set(current_events, client_index, PLAYER_EVENT_JOIN);
+
+        // The client starts out seeing nobody but its own join, everyone around it
+        // is sent as they come into view with this frames events
+        client_data->interest.count = 0;
+        interest_set_view(&client_data->interest, current_state, current_events, server->view_state, server->view_events);
+        game_events_set(server->view_events, client_index, PLAYER_EVENT_JOIN);
 
         // Serialise initialisation payload
-        msg_size = serialize_init_player(msg_buffer, server->server_frame, current_state, current_events, client_index);
+        msg_size = serialize_init_player(msg_buffer, server->server_frame, server->view_state, server->view_events, client_index);
+        sent = game_server_send(client_data, msg_buffer, msg_size);
     }
     pthread_mutex_unlock(&server->state_lock);
 
-    // Send the initialisation payload
-    ssize_t sent = send(client_data->fd, msg_buffer, msg_size, 0);
     if (sent < 0)
     {
         log_printf("Failed to send MSG_S2P_INIT_PLAYER to client %d\n", client_index);
@@ -272,10 +315,75 @@ void *game_server_client_thread(void *arg)
     uint8_t buffer[MAX_MESSAGE_SIZE];
     while (&client_data->is_connected && !atomic_load(&server->to_shutdown))
     {
-        // TODO: TCP receive into a receive buffer
-        ssize_t message_size = recv(client_data->fd, buffer, sizeof(buffer), 0);
+        ssize_t message_size = recv_message(client_data->fd, buffer, sizeof(buffer));
         if (message_size <= 0) break;
 
+        MessageHeader header;
+        memcpy(&header, buffer, sizeof(header));
+
+        // --------- Handle MSG_P2S_RESYNC_REQUEST ---------
+
+        if (header.type == MSG_P2S_RESYNC_REQUEST)
+        {
+            int frame;
+            int recv_index;
+            deserialize_p2s_resync_request(buffer, message_size, &frame, &recv_index);
+            assert(recv_index == client_index);
+
+            log_printf("WARN: Player %u requested a resync from frame %d\n", client_index, frame);
+
+            // Send the current confirmed state of the players the client sees, under the
+            // state lock so it is ordered with the frames which the client carries on from
+            pthread_mutex_lock(&server->state_lock);
+            {
+                const GameState *current_state = frame_ring_head(&server->frames);
+                const GameEvents *current_events = frame_ring_events(&server->frames, server->server_frame);
+                interest_set_view(&client_data->interest, current_state, current_events, server->view_state, server->view_events);
+                msg_size = serialize_s2p_state_resync(msg_buffer, server->server_frame, server->view_state, server->view_events);
+                if (game_server_send(client_data, msg_buffer, msg_size) < 0)
+                {
+                    log_printf("Failed to send MSG_S2P_STATE_RESYNC to client %d\n", client_index);
+                }
+                else
+                {
+                    log_printf("Sent MSG_S2P_STATE_RESYNC for frame %d to client %u\n", server->server_frame, client_index);
+                }
+            }
+            pthread_mutex_unlock(&server->state_lock);
+            continue;
+        }
+
+        // --------- Handle MSG_PING and MSG_PONG ---------
+
+        if (header.type == MSG_PING || header.type == MSG_PONG)
+        {
+            int frame;
+            int64_t origin_ns;
+            int64_t reply_ns;
+            deserialize_ping(buffer, message_size, &frame, &origin_ns, &reply_ns);
+            int64_t now_ns = pacer_now_ns();
+
+            // Answered from here rather than queued behind anything so it times just the network
+            if (header.type == MSG_PING)
+            {
+                pthread_mutex_lock(&server->clients_lock);
+                {
+                    frame = client_data->client_frame;
+                }
+                pthread_mutex_unlock(&server->clients_lock);
+                msg_size = serialize_ping(msg_buffer, MSG_PONG, frame, origin_ns, now_ns);
+                if (game_server_send(client_data, msg_buffer, msg_size) < 0) log_printf("Failed to send MSG_PONG to client %d\n", client_index);
+                continue;
+            }
+
+            pthread_mutex_lock(&server->clients_lock);
+            {
+                rtt_estimator_add_ping(&client_data->rtt, origin_ns, reply_ns, now_ns);
+            }
+            pthread_mutex_unlock(&server->clients_lock);
+            continue;
+        }
+
         // --------- Handle MSG_P2S_FRAME_INPUTS ---------
 
         int frame;
@@ -319,8 +427,8 @@ void *game_server_client_thread(void *arg)
                 }
 
                 // Copy clients inputs into local game events
-                GameEvents *events = &server->game_events[frame % FRAME_BUFFER_SIZE];
-                events->player_inputs[client_index] = input;
+                GameEvents *events = frame_ring_events(&server->frames, frame);
+                events->players[client_index].input = input;
                 client_data->client_frame = frame;
             }
             pthread_mutex_unlock(&server->clients_lock);
@@ -337,6 +445,13 @@ void *game_server_client_thread(void *arg)
 cleanup:
     log_printf("Client disconnecting (thread=%lu fd=%d player=%u)\n",
                client_data->thread_id, client_data->fd, client_index);
+    pthread_mutex_lock(&server->clients_lock);
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Client %d", client_index);
+        rtt_estimator_log_stats(&client_data->rtt, name);
+    }
+    pthread_mutex_unlock(&server->clients_lock);
 
     // Close client socket
     if (client_data->fd >= 0)
@@ -348,19 +463,34 @@ cleanup:
     // Remove player from local game state
     pthread_mutex_lock(&server->state_lock);
     {
-        GameEvents *current_events = &server->game_events[server->server_frame % FRAME_BUFFER_SIZE];
-        current_events->player_events[client_index] = PLAYER_EVENT_LEAVE;
+        GameEvents *current_events = frame_ring_events(&server->frames, server->server_frame);
+        game_events_set(current_events, client_index, PLAYER_EVENT_LEAVE);
     }
     pthread_mutex_unlock(&server->state_lock);
 
-    // Remove from the client data list
+    // Remove from the connected list, order does not matter so swap in the last slot
     pthread_mutex_lock(&server->clients_lock);
     {
         atomic_store(&client_data->is_connected, false);
-        server->client_count--;
+        for (int i = 0; i < server->client_count; ++i)
+        {
+            if (server->connected_slots[i] == client_index)
+            {
+                server->connected_slots[i] = server->connected_slots[--server->client_count];
+                break;
+            }
+        }
+        server->free_slots[server->free_count++] = client_index;
     }
     pthread_mutex_unlock(&server->clients_lock);
 
+    // The remaining clients may have been waiting on this one
+    pthread_mutex_lock(&server->state_lock);
+    {
+        if (game_server_can_simulate(server)) pthread_cond_signal(&server->simulation_loop_cond);
+    }
+    pthread_mutex_unlock(&server->state_lock);
+
     log_printf("Client thread finished for player %u\n", client_index);
     return NULL;
 }
@@ -385,23 +515,24 @@ void *game_simulation_thread(void *arg)
             }
 
             // Simulate just the next server frame with all clients events
-            GameState *current_state = &server->game_states[server->server_frame % FRAME_BUFFER_SIZE];
-            GameEvents *current_events = &server->game_events[server->server_frame % FRAME_BUFFER_SIZE];
-            GameState *next_state = &server->game_states[(server->server_frame + 1) % FRAME_BUFFER_SIZE];
+            // Who each client sees is worked out from where this frames movement starts
+            GameEvents *current_events = frame_ring_events(&server->frames, server->server_frame);
+            interest_build(&server->interest, frame_ring_head(&server->frames), current_events);
 
             log_printf("Server simulating frame %u\n", server->server_frame);
-            game_simulate(current_state, current_events, next_state);
+            frame_ring_advance(&server->frames);
 
-            // Broadcast out final confirmed events to all clients
-            uint8_t buffer[MAX_MESSAGE_SIZE];
-            size_t msg_size = serialize_s2p_frame_game_events(buffer, server->server_frame, current_events);
-            ssize_t sent = game_server_broadcast(server, buffer, msg_size, -1);
-            log_printf("Broadcasted MSG_S2P_FRAME_GAME_EVENTS for frame %d\n", server->server_frame);
+            // Every STATE_HASH_INTERVAL frames include a hash of the resulting state
+            // so clients can check their confirmed state against it
+            bool has_hash = (server->server_frame + 1) % STATE_HASH_INTERVAL == 0;
+
+            // Send out final confirmed events to all clients
+            ssize_t sent = game_server_send_frame(server, current_events, has_hash);
+            log_printf("Sent MSG_S2P_FRAME_GAME_EVENTS for frame %d (%zd bytes)\n", server->server_frame, sent);
 
             // Now we can iterate to start the next frame
             server->server_frame++;
-            GameEvents *next_events = &server->game_events[server->server_frame % FRAME_BUFFER_SIZE];
-            memset(next_events, 0, sizeof(GameEvents));
+            game_events_clear(frame_ring_events(&server->frames, server->server_frame));
         }
         pthread_mutex_unlock(&server->state_lock);
     }
@@ -410,18 +541,60 @@ void *game_simulation_thread(void *arg)
     return NULL;
 }
 
-ssize_t game_server_broadcast(GameServer *server, const uint8_t *buffer, size_t size, int exclude_fd)
+ssize_t game_server_send_frame(GameServer *server, const GameEvents *events, bool has_hash)
 {
+    // Each client gets the frames of the players in its area of interest and the edge players
+    // around them and any hash is of just those players, which is all the client holds, so it
+    // grows with the players around each client rather than everyone connected
+    // Each clients frame advantage is how far its inputs run ahead of the frame just simulated
+    // compared to the room on average, so clients hold their inputs arriving together by
+    // stretching or shrinking their ticks without the room as a whole drifting faster or slower
+    const GameState *state = frame_ring_head(&server->frames);
+    uint8_t buffer[MAX_MESSAGE_SIZE];
     ssize_t total_sent = 0;
     pthread_mutex_lock(&server->clients_lock);
     {
-        for (int i = 0; i < MAX_CLIENTS; ++i)
+        // Anyone who connected since the frame was simulated has not sent inputs yet
+        int64_t lead_sum = 0;
+        int lead_count = 0;
+        for (int i = 0; i < server->client_count; ++i)
+        {
+            int lead = server->client_data[server->connected_slots[i]].client_frame - server->server_frame;
+            if (lead < 0) continue;
+            lead_sum += lead;
+            lead_count++;
+        }
+
+        for (int i = 0; i < server->client_count; ++i)
         {
-            if (server->client_data[i].is_connected && server->client_data[i].fd != exclude_fd)
+            ClientData *client_data = &server->client_data[server->connected_slots[i]];
+            InterestSet *set = &client_data->interest;
+            int frame_count = interest_update(&server->interest, set, client_data->index, events);
+            if (frame_count < 0)
             {
-                ssize_t sent = send(server->client_data[i].fd, buffer, size, 0);
-                if (sent < 0) log_printf("Failed to broadcast to client %d: %d", i, sent);
-                total_sent += sent;
+                // Missing a frame would leave it stuck so drop it instead
+                log_printf("Failed to update the interest of client %d, disconnecting\n", client_data->index);
+                shutdown(client_data->fd, SHUT_RDWR);
+                continue;
+            }
+
+            // Not joined yet, it gets its first frame once it has
+            if (set->count == 0) continue;
+
+            uint32_t state_hash = has_hash ? interest_set_hash(&server->interest, set, state, server->view_state) : 0;
+            int64_t lead = client_data->client_frame - server->server_frame;
+            int frame_advantage = lead_count > 0 ? (int)((lead * lead_count - lead_sum) * FRAME_ADVANTAGE_SCALE / lead_count) : 0;
+            size_t msg_size = serialize_s2p_frame_player_frames(buffer, server->server_frame, server->interest.frame_slots, server->interest.frames,
+                                                                frame_count, has_hash, state_hash, frame_advantage);
+            ssize_t sent = game_server_send(client_data, buffer, msg_size);
+            if (sent < 0) log_printf("Failed to send frame to client %d: %d", client_data->index, sent);
+            else total_sent += sent;
+
+            // Time the connection every so often, the client answers as soon as it receives it
+            if (server->server_frame % PING_INTERVAL_FRAMES == 0)
+            {
+                msg_size = serialize_ping(buffer, MSG_PING, server->server_frame, pacer_now_ns(), 0);
+                if (game_server_send(client_data, buffer, msg_size) < 0) log_printf("Failed to send MSG_PING to client %d\n", client_data->index);
             }
         }
     }
@@ -443,10 +616,9 @@ bool game_server_can_simulate(GameServer *server)
             return false;
         }
 
-        for (int i = 0; i < MAX_CLIENTS; i++)
+        for (int i = 0; i < server->client_count; i++)
         {
-            if (server->client_data[i].is_connected &&
-                server->client_data[i].client_frame < server->server_frame)
+            if (server->client_data[server->connected_slots[i]].client_frame < server->server_frame)
             {
                 pthread_mutex_unlock(&server->clients_lock);
                 return false;
@@ -456,3 +628,17 @@ bool game_server_can_simulate(GameServer *server)
     pthread_mutex_unlock(&server->clients_lock);
     return true;
 }
+
+bool game_server_client_rtt(GameServer *server, int client_index, RttStats *out_stats)
+{
+    // Round trip to a connected client so far, false if it is not connected
+    bool connected;
+    pthread_mutex_lock(&server->clients_lock);
+    {
+        ClientData *client_data = &server->client_data[client_index];
+        connected = client_data->is_connected;
+        if (connected) rtt_estimator_stats(&client_data->rtt, out_stats);
+    }
+    pthread_mutex_unlock(&server->clients_lock);
+    return connected;
+}
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "../shared/framering.h"
 #include "../shared/gameimpl.h"
+#include "../shared/interest.h"
+#include "../shared/rtt.h"
 #include <pthread.h>
 #include <signal.h>
 #include <stdatomic.h>
@@ -10,9 +13,14 @@ typedef struct
 {
     bool is_connected;
     int fd;
+    // Held for every message sent, the client thread answers pings while frames go out
+    pthread_mutex_t send_lock;
     int index;
     pthread_t thread_id;
     int client_frame;
+    InterestSet interest;
+    // From pings every PING_INTERVAL_FRAMES, under clients_lock
+    RttEstimator rtt;
 } ClientData;
 
 typedef struct
@@ -26,11 +34,23 @@ typedef struct
     pthread_mutex_t state_lock;
     pthread_cond_t simulation_loop_cond;
 
+    // Slots are allocated for max_clients up front, free_slots is a stack of unused slots
+    // and connected_slots the dense list of used ones so loops only visit connected clients
+    int max_clients;
     int client_count;
+    int free_count;
+    ClientData *client_data;
+    int *free_slots;
+    int *connected_slots;
+
     int server_frame;
-    ClientData client_data[MAX_CLIENTS];
-    GameState game_states[FRAME_BUFFER_SIZE];
-    GameEvents game_events[FRAME_BUFFER_SIZE];
+    FrameRing frames;
+
+    // Each client is only sent the players around it, see interest.h
+    // view_state and view_events are scratch for the states sent to clients under state_lock
+    Interest interest;
+    GameState *view_state;
+    GameEvents *view_events;
 } GameServer;
 
 typedef struct
@@ -39,11 +59,12 @@ typedef struct
     int index;
 } ClientThreadArgs;
 
-int game_server_init(GameServer *server, int port);
+int game_server_init(GameServer *server, int port, int max_clients);
 void game_server_shutdown(GameServer *server);
 void *game_server_accept_thread(void *arg);
 void *game_server_client_thread(void *arg);
 void *game_simulation_thread(void *arg);
 
-ssize_t game_server_broadcast(GameServer *server, const uint8_t *buffer, size_t size, int exclude_fd);
+ssize_t game_server_send_frame(GameServer *server, const GameEvents *events, bool has_hash);
 bool game_server_can_simulate(GameServer *server);
+bool game_server_client_rtt(GameServer *server, int client_index, RttStats *out_stats);
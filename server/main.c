@@ -1,5 +1,5 @@
 // cbuild: -I../ -g
-// cbuild: gameserver.c ../shared/gameimpl.c ../shared/protocol.c ../shared/log.c
+// cbuild: gameserver.c ../shared/gameimpl.c ../shared/spatialhash.c ../shared/interest.c ../shared/protocol.c ../shared/log.c ../shared/framering.c ../shared/pacer.c ../shared/rtt.c -lm
 
 #include "gameserver.h"
 #include "../shared/gameimpl.h"
@@ -33,15 +33,23 @@ void init_sigaction_handler(struct sigaction *sa)
     sigaction(SIGTERM, sa, NULL);
 }
 
-int main()
+int main(int argc, char **argv)
 {
     log_printf("Server application started\n");
 
+    // Player capacity can be given as the first argument
+    int max_clients = argc > 1 ? atoi(argv[1]) : DEFAULT_MAX_CLIENTS;
+    if (max_clients < 1 || max_clients > MAX_CLIENTS_LIMIT)
+    {
+        fprintf(stderr, "Max clients must be between 1 and %d\n", MAX_CLIENTS_LIMIT);
+        return 1;
+    }
+
     struct sigaction sa;
     init_sigaction_handler(&sa);
 
     GameServer server;
-    if (game_server_init(&server, PORT) != 0)
+    if (game_server_init(&server, PORT, max_clients) != 0)
     {
         perror("game_server_init");
         return 1;
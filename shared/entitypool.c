@@ -0,0 +1,116 @@
+#include "entitypool.h"
+#include <assert.h>
+#include <string.h>
+
+static EntitySlot *entity_pool_slots(const EntityPool *pool)
+{
+    return (EntitySlot *)(entity_pool_entities(pool) + pool->capacity);
+}
+
+static uint16_t *entity_pool_dense_slots(const EntityPool *pool)
+{
+    return (uint16_t *)(entity_pool_slots(pool) + pool->capacity);
+}
+
+size_t entity_pool_size(int capacity)
+{
+    return sizeof(EntityPool) + capacity * (sizeof(Entity) + sizeof(EntitySlot) + sizeof(uint16_t));
+}
+
+void entity_pool_init(EntityPool *pool, int capacity)
+{
+    // Handles keep slot + 1 in 16 bits
+    assert(capacity <= ENTITY_POOL_MAX_CAPACITY);
+    memset(pool, 0, sizeof(*pool));
+    pool->capacity = capacity;
+}
+
+void entity_pool_copy(EntityPool *out, const EntityPool *pool)
+{
+    // Only the live entities and the slots ever used, so the cost follows the entity count
+    // Nothing reads slots past high_water so whatever the destination had there can stay
+    assert(out->capacity == pool->capacity);
+    if (out == pool) return;
+    *out = *pool;
+    memcpy(entity_pool_entities(out), entity_pool_entities(pool), pool->count * sizeof(Entity));
+    memcpy(entity_pool_slots(out), entity_pool_slots(pool), pool->high_water * sizeof(EntitySlot));
+    memcpy(entity_pool_dense_slots(out), entity_pool_dense_slots(pool), pool->count * sizeof(uint16_t));
+}
+
+Entity *entity_pool_entities(const EntityPool *pool)
+{
+    return (Entity *)(pool + 1);
+}
+
+EntityHandle entity_pool_handle(const EntityPool *pool, int index)
+{
+    int slot = entity_pool_dense_slots(pool)[index];
+    return ((EntityHandle)entity_pool_slots(pool)[slot].generation << 16) | (EntityHandle)(slot + 1);
+}
+
+Entity *entity_pool_get(const EntityPool *pool, EntityHandle handle)
+{
+    // The entity a handle refers to, or NULL once it has been despawned
+    int slot = (int)(handle & 0xFFFF) - 1;
+    if (slot < 0 || slot >= pool->high_water) return NULL;
+
+    const EntitySlot *entity_slot = &entity_pool_slots(pool)[slot];
+    if (entity_slot->generation != handle >> 16) return NULL;
+    if (entity_slot->index >= pool->count || entity_pool_dense_slots(pool)[entity_slot->index] != slot) return NULL;
+    return &entity_pool_entities(pool)[entity_slot->index];
+}
+
+EntityHandle entity_pool_spawn(EntityPool *pool, const Entity *entity)
+{
+    // Reuses the most recently freed slot first so the same spawns always get the same handles
+    if (pool->count == pool->capacity) return ENTITY_HANDLE_NONE;
+
+    EntitySlot *slots = entity_pool_slots(pool);
+    int slot;
+    if (pool->free_head != 0)
+    {
+        slot = pool->free_head - 1;
+        pool->free_head = slots[slot].index;
+    }
+    else
+    {
+        slot = pool->high_water++;
+        slots[slot].generation = 0;
+    }
+
+    int index = pool->count++;
+    entity_pool_entities(pool)[index] = *entity;
+    entity_pool_dense_slots(pool)[index] = (uint16_t)slot;
+    slots[slot].index = (uint16_t)index;
+    return ((EntityHandle)slots[slot].generation << 16) | (EntityHandle)(slot + 1);
+}
+
+bool entity_pool_despawn(EntityPool *pool, EntityHandle handle)
+{
+    Entity *entity = entity_pool_get(pool, handle);
+    if (entity == NULL) return false;
+    entity_pool_remove(pool, (int)(entity - entity_pool_entities(pool)));
+    return true;
+}
+
+void entity_pool_remove(EntityPool *pool, int index)
+{
+    // Despawn by position in the dense array, the last entity moves into its place
+    // so loops removing as they go should walk backwards
+    Entity *entities = entity_pool_entities(pool);
+    EntitySlot *slots = entity_pool_slots(pool);
+    uint16_t *dense_slots = entity_pool_dense_slots(pool);
+    int slot = dense_slots[index];
+
+    int last = --pool->count;
+    if (index != last)
+    {
+        entities[index] = entities[last];
+        dense_slots[index] = dense_slots[last];
+        slots[dense_slots[index]].index = (uint16_t)index;
+    }
+
+    slots[slot].generation++;
+    slots[slot].index = (uint16_t)pool->free_head;
+    pool->free_head = slot + 1;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "gameimpl.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Fixed capacity pool of non-player entities, projectiles, pickups and the like
+//
+// One flat block holding no pointers, so a snapshot is a memcpy and rolls back for free.
+// Entities are kept densely packed for iteration and despawning moves the last one into the
+// gap. They are referred to by handles of a slot and the slots generation, which changes on
+// every despawn so stale handles are caught.
+// Free slots are a list threaded through the slot table and slots past high_water have never
+// been used, so a zeroed pool is empty and nothing here ever allocates.
+// Not part of GameState until something spawns entities. Then it goes after the active slots,
+// with its changes in game_simulate_logged()s undo log and the pool in the serialized state
+
+typedef uint32_t EntityHandle;
+#define ENTITY_HANDLE_NONE 0
+#define ENTITY_POOL_MAX_CAPACITY 65535
+
+typedef struct
+{
+    game_pos_t x, y;
+    game_pos_t vx, vy;
+    uint16_t owner;
+    uint16_t ttl;
+    uint8_t type;
+} Entity;
+
+typedef struct
+{
+    uint16_t generation;
+    uint16_t index;
+} EntitySlot;
+
+// Followed in memory by Entity entities[capacity], EntitySlot slots[capacity] and
+// uint16_t dense_slots[capacity]. A slots index is its entity while alive and the
+// next free slot + 1 while free, dense_slots maps each entity back to its slot
+typedef struct
+{
+    int capacity;
+    int count;
+    int high_water;
+    int free_head;
+} EntityPool;
+
+size_t entity_pool_size(int capacity);
+void entity_pool_init(EntityPool *pool, int capacity);
+void entity_pool_copy(EntityPool *out, const EntityPool *pool);
+
+Entity *entity_pool_entities(const EntityPool *pool);
+EntityHandle entity_pool_handle(const EntityPool *pool, int index);
+Entity *entity_pool_get(const EntityPool *pool, EntityHandle handle);
+
+EntityHandle entity_pool_spawn(EntityPool *pool, const Entity *entity);
+bool entity_pool_despawn(EntityPool *pool, EntityHandle handle);
+void entity_pool_remove(EntityPool *pool, int index);
@@ -0,0 +1,299 @@
+#include "framering.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static GameState *frame_ring_checkpoint(const FrameRing *ring, int slot)
+{
+    return (GameState *)(ring->checkpoints + slot * ring->state_size);
+}
+
+static const GameState *frame_ring_checkpoint_state(const FrameRing *ring, int slot)
+{
+    return frame_ring_checkpoint(ring, ring->checkpoint_owners[slot]);
+}
+
+int frame_ring_init(FrameRing *ring, int capacity, FrameRingMode mode, int checkpoint_interval)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->mode = mode;
+    ring->capacity = capacity;
+    ring->state_size = game_state_size(capacity);
+    ring->events_size = game_events_size(capacity);
+
+    ring->events = malloc(FRAME_BUFFER_SIZE * ring->events_size);
+    ring->scratch = game_state_alloc(capacity);
+    if (ring->events == NULL || ring->scratch == NULL)
+    {
+        perror("malloc()");
+        frame_ring_free(ring);
+        return 1;
+    }
+
+    if (mode == FRAME_RING_UNDO_LOG)
+    {
+        // Worst case every player is written every frame
+        ring->undo_logs = malloc(FRAME_BUFFER_SIZE * capacity * sizeof(PlayerUndo));
+        ring->undo_counts = malloc(FRAME_BUFFER_SIZE * sizeof(int));
+        if (ring->undo_logs == NULL || ring->undo_counts == NULL)
+        {
+            perror("malloc()");
+            frame_ring_free(ring);
+            return 1;
+        }
+    }
+    else
+    {
+        // Interval has to divide the buffer so checkpoint slots wrap with the frames
+        if (checkpoint_interval < 1 || FRAME_BUFFER_SIZE % checkpoint_interval != 0)
+        {
+            fprintf(stderr, "Invalid checkpoint interval %d for buffer size %d\n", checkpoint_interval, FRAME_BUFFER_SIZE);
+            frame_ring_free(ring);
+            return 1;
+        }
+
+        ring->checkpoint_interval = checkpoint_interval;
+        ring->checkpoint_count = FRAME_BUFFER_SIZE / checkpoint_interval;
+        ring->checkpoints = malloc(ring->checkpoint_count * ring->state_size);
+        ring->checkpoint_frames = malloc(ring->checkpoint_count * sizeof(int));
+        ring->checkpoint_owners = malloc(ring->checkpoint_count * sizeof(int));
+        ring->checkpoint_shares = malloc(ring->checkpoint_count * sizeof(int));
+        if (ring->checkpoints == NULL || ring->checkpoint_frames == NULL || ring->checkpoint_owners == NULL || ring->checkpoint_shares == NULL)
+        {
+            perror("malloc()");
+            frame_ring_free(ring);
+            return 1;
+        }
+        for (int i = 0; i < ring->checkpoint_count; ++i) game_state_init(frame_ring_checkpoint(ring, i), capacity);
+    }
+
+    game_state_init(ring->scratch, capacity);
+    frame_ring_reset(ring, 0, ring->scratch);
+    return 0;
+}
+
+void frame_ring_free(FrameRing *ring)
+{
+    free(ring->events);
+    free(ring->scratch);
+    free(ring->checkpoints);
+    free(ring->checkpoint_frames);
+    free(ring->checkpoint_owners);
+    free(ring->checkpoint_shares);
+    free(ring->undo_logs);
+    free(ring->undo_counts);
+    ring->events = NULL;
+    ring->scratch = NULL;
+    ring->checkpoints = NULL;
+    ring->checkpoint_frames = NULL;
+    ring->checkpoint_owners = NULL;
+    ring->checkpoint_shares = NULL;
+    ring->undo_logs = NULL;
+    ring->undo_counts = NULL;
+}
+
+size_t frame_ring_memory(const FrameRing *ring)
+{
+    size_t memory = sizeof(FrameRing) + FRAME_BUFFER_SIZE * ring->events_size + ring->state_size;
+    if (ring->mode == FRAME_RING_UNDO_LOG)
+    {
+        return memory + FRAME_BUFFER_SIZE * (ring->capacity * sizeof(PlayerUndo) + sizeof(int));
+    }
+    return memory + ring->checkpoint_count * (ring->state_size + 3 * sizeof(int));
+}
+
+static int frame_ring_slot(const FrameRing *ring, int frame)
+{
+    return (frame / ring->checkpoint_interval) % ring->checkpoint_count;
+}
+
+void frame_ring_reset(FrameRing *ring, int frame, const GameState *state)
+{
+    // Drop all history and start again from the given state
+    for (int i = 0; i < FRAME_BUFFER_SIZE; ++i) game_events_init(frame_ring_events(ring, i), ring->capacity);
+    frame_ring_splice(ring, frame, state, frame, state);
+}
+
+void frame_ring_splice(FrameRing *ring, int base_frame, const GameState *base_state, int head_frame, const GameState *head_state)
+{
+    // Drop all states and start again from ones simulated elsewhere, keeping the events
+    // The base state is always kept even if it is not on a checkpoint frame, as it cannot be regenerated
+    // The head is put straight at head_frame so frames in between cannot be rewound to
+    // The undo log would have nothing to rewind over so it re-simulates up to the head instead
+    assert(base_state->capacity == ring->capacity && head_frame >= base_frame && head_frame - base_frame < FRAME_BUFFER_SIZE);
+    ring->head_frame = base_frame;
+
+    if (ring->mode == FRAME_RING_UNDO_LOG)
+    {
+        ring->tail_frame = base_frame;
+        game_state_copy(ring->scratch, base_state);
+        ring->head_in_scratch = true;
+        while (ring->head_frame < head_frame) frame_ring_advance(ring);
+        return;
+    }
+
+    for (int i = 0; i < ring->checkpoint_count; ++i)
+    {
+        ring->checkpoint_frames[i] = -1;
+        ring->checkpoint_owners[i] = i;
+        ring->checkpoint_shares[i] = 0;
+    }
+
+    int slot = frame_ring_slot(ring, base_frame);
+    game_state_copy(frame_ring_checkpoint(ring, slot), base_state);
+    ring->checkpoint_frames[slot] = base_frame;
+    ring->head_in_scratch = false;
+    if (head_frame == base_frame) return;
+
+    game_state_copy(ring->scratch, head_state);
+    ring->head_frame = head_frame;
+    ring->head_in_scratch = true;
+}
+
+GameEvents *frame_ring_events(FrameRing *ring, int frame)
+{
+    return (GameEvents *)(ring->events + (frame % FRAME_BUFFER_SIZE) * ring->events_size);
+}
+
+const GameState *frame_ring_head(const FrameRing *ring)
+{
+    if (ring->head_in_scratch) return ring->scratch;
+    return frame_ring_checkpoint_state(ring, frame_ring_slot(ring, ring->head_frame));
+}
+
+static void frame_ring_unshare(FrameRing *ring, int slot)
+{
+    // Make a checkpoint slot safe to write to
+    // Stop it using another slots state, or hand its own state over to the slots using it
+    int owner = ring->checkpoint_owners[slot];
+    if (owner != slot)
+    {
+        ring->checkpoint_shares[owner]--;
+        ring->checkpoint_owners[slot] = slot;
+        return;
+    }
+    if (ring->checkpoint_shares[slot] == 0) return;
+
+    int new_owner = -1;
+    for (int i = 0; i < ring->checkpoint_count; ++i)
+    {
+        if (i == slot || ring->checkpoint_owners[i] != slot) continue;
+        if (new_owner < 0)
+        {
+            new_owner = i;
+            game_state_copy(frame_ring_checkpoint(ring, i), frame_ring_checkpoint(ring, slot));
+            ring->checkpoint_owners[i] = i;
+        }
+        else
+        {
+            ring->checkpoint_owners[i] = new_owner;
+            ring->checkpoint_shares[new_owner]++;
+        }
+    }
+    ring->checkpoint_shares[slot] = 0;
+}
+
+int frame_ring_window_end(const FrameRing *ring, int base_frame)
+{
+    // Last frame the head can be advanced from without overwriting the checkpoint
+    // or undo log needed to get back to base_frame, same as the events ring with an interval of 1
+    int checkpoint_frame = base_frame;
+    if (ring->mode == FRAME_RING_CHECKPOINTS) checkpoint_frame -= base_frame % ring->checkpoint_interval;
+    return checkpoint_frame + FRAME_BUFFER_SIZE - 1;
+}
+
+void frame_ring_advance(FrameRing *ring)
+{
+    const GameEvents *current_events = frame_ring_events(ring, ring->head_frame);
+    int next_frame = ring->head_frame + 1;
+
+    // Simulate the head in place logging only the players that changed
+    if (ring->mode == FRAME_RING_UNDO_LOG)
+    {
+        int log_slot = ring->head_frame % FRAME_BUFFER_SIZE;
+        PlayerUndo *undo_log = &ring->undo_logs[log_slot * ring->capacity];
+        ring->undo_counts[log_slot] = 0;
+        if (!game_events_idle(current_events, ring->scratch))
+        {
+            ring->undo_counts[log_slot] = game_simulate_logged(ring->scratch, current_events, undo_log);
+        }
+        ring->head_frame = next_frame;
+        if (ring->tail_frame <= next_frame - FRAME_BUFFER_SIZE) ring->tail_frame = next_frame - FRAME_BUFFER_SIZE + 1;
+        return;
+    }
+
+    // Simulate the head frame with its events into the next frame
+    // Checkpoint frames are written straight into their slot, others into scratch
+    // Idle frames leave the head where it is, or share it if they reach a checkpoint
+    const GameState *current_state = frame_ring_head(ring);
+    bool idle = game_events_idle(current_events, current_state);
+    ring->head_frame = next_frame;
+
+    if (next_frame % ring->checkpoint_interval != 0)
+    {
+        if (idle) return;
+        game_simulate(current_state, current_events, ring->scratch);
+        ring->head_in_scratch = true;
+        return;
+    }
+
+    int slot = frame_ring_slot(ring, next_frame);
+    ring->checkpoint_frames[slot] = next_frame;
+    if (idle && !ring->head_in_scratch)
+    {
+        int owner = ring->checkpoint_owners[frame_ring_slot(ring, next_frame - 1)];
+        if (ring->checkpoint_owners[slot] != owner)
+        {
+            frame_ring_unshare(ring, slot);
+            ring->checkpoint_owners[slot] = owner;
+            ring->checkpoint_shares[owner]++;
+        }
+        return;
+    }
+
+    frame_ring_unshare(ring, slot);
+    GameState *next_state = frame_ring_checkpoint(ring, slot);
+    if (idle) game_state_copy(next_state, current_state);
+    else game_simulate(current_state, current_events, next_state);
+    ring->head_in_scratch = false;
+}
+
+void frame_ring_rewind(FrameRing *ring, int frame)
+{
+    // Move the head back to an earlier frame, discarding everything after it
+    assert(frame <= ring->head_frame);
+    if (frame == ring->head_frame) return;
+
+    // Undo each frame newest first
+    if (ring->mode == FRAME_RING_UNDO_LOG)
+    {
+        assert(frame >= ring->tail_frame);
+        while (ring->head_frame > frame)
+        {
+            ring->head_frame--;
+            int log_slot = ring->head_frame % FRAME_BUFFER_SIZE;
+            game_undo(ring->scratch, &ring->undo_logs[log_slot * ring->capacity], ring->undo_counts[log_slot]);
+        }
+        return;
+    }
+
+    // Regenerate the state from the checkpoint at or before the frame
+    int slot = frame_ring_slot(ring, frame);
+    int checkpoint_frame = ring->checkpoint_frames[slot];
+    assert(checkpoint_frame >= 0 && checkpoint_frame <= frame && frame - checkpoint_frame < ring->checkpoint_interval);
+
+    ring->head_frame = checkpoint_frame;
+    ring->head_in_scratch = false;
+    while (ring->head_frame < frame)
+    {
+        const GameState *current_state = frame_ring_head(ring);
+        const GameEvents *current_events = frame_ring_events(ring, ring->head_frame);
+        if (!game_events_idle(current_events, current_state))
+        {
+            game_simulate(current_state, current_events, ring->scratch);
+            ring->head_in_scratch = true;
+        }
+        ring->head_frame++;
+    }
+}
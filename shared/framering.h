@@ -0,0 +1,65 @@
+#pragma once
+
+#include "gameimpl.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// History of game states and events for the last FRAME_BUFFER_SIZE frames
+//
+// FRAME_RING_CHECKPOINTS: only every checkpoint_interval'th state is stored, anything
+// in between is regenerated on demand by re-simulating from the checkpoint with the
+// event log. An interval of 1 stores every state and never re-simulates.
+//
+// FRAME_RING_UNDO_LOG: only the head state is stored, simulated in place while logging
+// the previous value of each player it writes. Rewinding replays the log backwards.
+//
+// States and events are sized by the player capacity so they are stored back to back
+// in byte buffers with a stride rather than as arrays of structs.
+//
+// Idle frames, where game_events_idle() says nothing would change, are never simulated.
+// A checkpoint reached by an idle frame shares the previous checkpoint's state instead of
+// copying it, checkpoint_owners[slot] is the slot actually holding it. Before a shared
+// state is overwritten it is copied to one of the slots still using it.
+
+typedef enum
+{
+    FRAME_RING_CHECKPOINTS,
+    FRAME_RING_UNDO_LOG,
+} FrameRingMode;
+
+typedef struct
+{
+    FrameRingMode mode;
+    int capacity;
+    size_t state_size;
+    size_t events_size;
+    uint8_t *events;
+
+    int checkpoint_interval;
+    int checkpoint_count;
+    uint8_t *checkpoints;
+    int *checkpoint_frames;
+    int *checkpoint_owners;
+    int *checkpoint_shares;
+
+    int tail_frame;
+    PlayerUndo *undo_logs;
+    int *undo_counts;
+
+    int head_frame;
+    bool head_in_scratch;
+    GameState *scratch;
+} FrameRing;
+
+int frame_ring_init(FrameRing *ring, int capacity, FrameRingMode mode, int checkpoint_interval);
+void frame_ring_free(FrameRing *ring);
+size_t frame_ring_memory(const FrameRing *ring);
+
+void frame_ring_reset(FrameRing *ring, int frame, const GameState *state);
+void frame_ring_splice(FrameRing *ring, int base_frame, const GameState *base_state, int head_frame, const GameState *head_state);
+GameEvents *frame_ring_events(FrameRing *ring, int frame);
+const GameState *frame_ring_head(const FrameRing *ring);
+int frame_ring_window_end(const FrameRing *ring, int base_frame);
+
+void frame_ring_advance(FrameRing *ring);
+void frame_ring_rewind(FrameRing *ring, int frame);
@@ -0,0 +1,67 @@
+#include "gamebatch.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int game_batch_init(GameBatch *batch, int world_count, int capacity)
+{
+    batch->world_count = world_count;
+    batch->world_stride = (world_count + SOA_LANES - 1) / SOA_LANES * SOA_LANES;
+    batch->capacity = capacity;
+    int count = batch->world_stride * capacity;
+    batch->from_x = malloc(count * sizeof(game_pos_t));
+    batch->from_y = malloc(count * sizeof(game_pos_t));
+    if (batch->from_x == NULL || batch->from_y == NULL)
+    {
+        perror("malloc()");
+        free(batch->from_x);
+        free(batch->from_y);
+        return 1;
+    }
+    if (game_soa_init(&batch->state, &batch->events, count) != 0)
+    {
+        game_batch_free(batch);
+        return 1;
+    }
+    return 0;
+}
+
+void game_batch_free(GameBatch *batch)
+{
+    game_soa_free(&batch->state, &batch->events);
+    free(batch->from_x);
+    free(batch->from_y);
+    memset(batch, 0, sizeof(*batch));
+}
+
+void game_batch_load_state(GameBatch *batch, int world, const GameState *source)
+{
+    assert(world >= 0 && world < batch->world_count && source->capacity == batch->capacity);
+    game_soa_load_state_strided(&batch->state, world, batch->world_stride, source);
+}
+
+void game_batch_store_state(const GameBatch *batch, int world, GameState *out)
+{
+    assert(world >= 0 && world < batch->world_count && out->capacity == batch->capacity);
+    game_soa_store_state_strided(&batch->state, world, batch->world_stride, out);
+}
+
+void game_batch_load_events(GameBatch *batch, int world, const GameEvents *source)
+{
+    // Events are not cleared after simulating, each world has to load its events every frame
+    assert(world >= 0 && world < batch->world_count && source->capacity == batch->capacity);
+    game_soa_load_events_strided(&batch->events, world, batch->world_stride, source);
+}
+
+void game_batch_simulate(GameBatch *batch)
+{
+    // Every player moves independently so the layout makes no difference to the kernel
+    // Collisions then test every pair of each world with the positions from before it moved,
+    // consecutive worlds sit side by side so that vectorises across them like the kernel
+    int count = batch->world_stride * batch->capacity;
+    memcpy(batch->from_x, batch->state.x, count * sizeof(game_pos_t));
+    memcpy(batch->from_y, batch->state.y, count * sizeof(game_pos_t));
+    game_simulate_soa(&batch->state, &batch->events);
+    game_soa_collide(&batch->state, &batch->events, batch->from_x, batch->from_y, 1, batch->world_stride, batch->capacity, batch->world_count);
+}
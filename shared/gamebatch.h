@@ -0,0 +1,29 @@
+#pragma once
+
+#include "gamesoa.h"
+
+// Many independent worlds of the same capacity advanced together by one SoA kernel pass
+// Laid out world major: player i of world w is at i * world_stride + w, so each vector holds
+// the same player across SOA_LANES worlds and small worlds never leave lanes empty
+// world_stride is world_count padded to SOA_LANES, the padding worlds are never active
+// Collisions are resolved after the kernel pass, against positions saved before it
+
+typedef struct
+{
+    int world_count;
+    int world_stride;
+    int capacity;
+    GameStateSoA state;
+    GameEventsSoA events;
+    game_pos_t *from_x;
+    game_pos_t *from_y;
+} GameBatch;
+
+int game_batch_init(GameBatch *batch, int world_count, int capacity);
+void game_batch_free(GameBatch *batch);
+
+void game_batch_load_state(GameBatch *batch, int world, const GameState *source);
+void game_batch_store_state(const GameBatch *batch, int world, GameState *out);
+void game_batch_load_events(GameBatch *batch, int world, const GameEvents *source);
+
+void game_batch_simulate(GameBatch *batch);
@@ -1,37 +1,372 @@
 #include "gameimpl.h"
 #include "log.h"
+#include "spatialhash.h"
 #include <assert.h>
+#include <stdlib.h>
 
-void game_simulate(const GameState *current, const GameEvents *events, GameState *out)
+size_t game_state_size(int capacity)
+{
+    // Header, capacity players, capacity active slots, padded so states can be packed in arrays
+    size_t size = sizeof(GameState) + capacity * (sizeof(PlayerData) + sizeof(uint16_t));
+    return (size + 7) & ~(size_t)7;
+}
+
+GameState *game_state_alloc(int capacity)
+{
+    GameState *state = malloc(game_state_size(capacity));
+    if (state != NULL) game_state_init(state, capacity);
+    return state;
+}
+
+void game_state_init(GameState *state, int capacity)
+{
+    memset(state, 0, game_state_size(capacity));
+    state->capacity = capacity;
+}
+
+uint16_t *game_state_active_slots(const GameState *state)
+{
+    return (uint16_t *)&state->player_data[state->capacity];
+}
+
+void game_state_copy(GameState *out, const GameState *state)
 {
-    *out = *current;
+    // Only touches the active players of both states so the cost follows the player count
+    // Inactive players are only guaranteed to have active = false, positions are left as is
+    if (out == state) return;
+    if (out->capacity != state->capacity)
+    {
+        memcpy(out, state, game_state_size(state->capacity));
+        return;
+    }
+
+    const uint16_t *out_slots = game_state_active_slots(out);
+    for (int k = 0; k < out->active_count; ++k) out->player_data[out_slots[k]].active = false;
 
-    int active_players = 0;
-    for (int i = 0; i < MAX_CLIENTS; ++i)
+    const uint16_t *slots = game_state_active_slots(state);
+    for (int k = 0; k < state->active_count; ++k) out->player_data[slots[k]] = state->player_data[slots[k]];
+
+    memcpy(game_state_active_slots(out), slots, state->active_count * sizeof(uint16_t));
+    out->active_count = state->active_count;
+}
+
+void game_state_rebuild_active(GameState *state)
+{
+    // Regenerate the active slots from the players, for states filled in directly
+    uint16_t *slots = game_state_active_slots(state);
+    state->active_count = 0;
+    for (int i = 0; i < state->capacity; ++i)
     {
-        const PlayerEvent *player_event = &events->player_events[i];
-        const PlayerInput *player_input = &events->player_inputs[i];
-        PlayerData *player_data = &out->player_data[i];
+        if (state->player_data[i].active) slots[state->active_count++] = (uint16_t)i;
+    }
+}
+
+_Static_assert(sizeof(game_pos_t) == sizeof(uint32_t), "positions are hashed as 32 bit words");
+
+#define HASH_LANES 4
+#define HASH_PRIME_1 0x9E3779B1u
+#define HASH_PRIME_2 0x85EBCA77u
+#define HASH_PRIME_3 0xC2B2AE3Du
+
+static uint32_t hash_round(uint32_t lane, uint32_t word)
+{
+    lane += word * HASH_PRIME_2;
+    lane = (lane << 13) | (lane >> 19);
+    return lane * HASH_PRIME_1;
+}
+
+uint32_t game_state_hash(const GameState *state)
+{
+    // Inactive players are skipped as their positions are not kept in sync between copies
+    return game_state_hash_slots(state, game_state_active_slots(state), state->active_count);
+}
+
+uint32_t game_state_hash_slots(const GameState *state, const uint16_t *slots, int count)
+{
+    // xxHash32 style over the slot and position bits of each of the given players
+    // Players are mixed into independent lanes a block at a time so the rounds vectorise
+    // The hash of ascending active slots of one state equals game_state_hash() of a state
+    // holding only those players, which is how the server checks a clients partial view
+    uint32_t lanes[HASH_LANES] = {HASH_PRIME_1, HASH_PRIME_2, HASH_PRIME_3, HASH_PRIME_1 ^ HASH_PRIME_2};
 
-        // Handle events
-        if (*player_event == PLAYER_EVENT_JOIN)
+    int k = 0;
+    for (; k + HASH_LANES <= count; k += HASH_LANES)
+    {
+        uint32_t xs[HASH_LANES], ys[HASH_LANES];
+        for (int j = 0; j < HASH_LANES; ++j)
         {
-            player_data->active = true;
-            player_data->x = 400.0f;
-            player_data->y = 400.0f;
-            log_printf("Spawning player %d\n", i);
+            memcpy(&xs[j], &state->player_data[slots[k + j]].x, sizeof(uint32_t));
+            memcpy(&ys[j], &state->player_data[slots[k + j]].y, sizeof(uint32_t));
         }
-        if (*player_event == PLAYER_EVENT_LEAVE)
+        for (int j = 0; j < HASH_LANES; ++j)
         {
-            player_data->active = false;
+            lanes[j] = hash_round(lanes[j], slots[k + j]);
+            lanes[j] = hash_round(lanes[j], xs[j]);
+            lanes[j] = hash_round(lanes[j], ys[j]);
         }
+    }
+    for (int j = 0; k < count; ++k, ++j)
+    {
+        uint32_t x, y;
+        memcpy(&x, &state->player_data[slots[k]].x, sizeof(uint32_t));
+        memcpy(&y, &state->player_data[slots[k]].y, sizeof(uint32_t));
+        lanes[j] = hash_round(lanes[j], slots[k]);
+        lanes[j] = hash_round(lanes[j], x);
+        lanes[j] = hash_round(lanes[j], y);
+    }
+
+    // Merge the lanes and avalanche
+    uint32_t hash = (uint32_t)count;
+    for (int j = 0; j < HASH_LANES; ++j) hash = hash_round(hash, lanes[j]);
+    hash ^= hash >> 15;
+    hash *= HASH_PRIME_2;
+    hash ^= hash >> 13;
+    hash *= HASH_PRIME_3;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static void game_state_set_active(GameState *state, int index, bool active)
+{
+    // Keep the active slots sorted so iteration order never depends on join order
+    PlayerData *player_data = &state->player_data[index];
+    if (player_data->active == active) return;
+    player_data->active = active;
+
+    uint16_t *slots = game_state_active_slots(state);
+    int k = 0;
+    while (k < state->active_count && slots[k] < index) ++k;
+
+    if (active)
+    {
+        memmove(&slots[k + 1], &slots[k], (state->active_count - k) * sizeof(uint16_t));
+        slots[k] = (uint16_t)index;
+        state->active_count++;
+    }
+    else
+    {
+        assert(k < state->active_count && slots[k] == index);
+        memmove(&slots[k], &slots[k + 1], (state->active_count - k - 1) * sizeof(uint16_t));
+        state->active_count--;
+    }
+}
+
+size_t game_events_size(int capacity)
+{
+    return sizeof(GameEvents) + capacity * sizeof(PlayerFrame);
+}
+
+GameEvents *game_events_alloc(int capacity)
+{
+    GameEvents *events = malloc(game_events_size(capacity));
+    if (events != NULL) game_events_init(events, capacity);
+    return events;
+}
+
+void game_events_init(GameEvents *events, int capacity)
+{
+    events->capacity = capacity;
+    game_events_clear(events);
+}
+
+void game_events_clear(GameEvents *events)
+{
+    events->event_count = 0;
+    memset(events->players, 0, events->capacity * sizeof(PlayerFrame));
+}
+
+void game_events_copy(GameEvents *out, const GameEvents *events)
+{
+    if (out == events) return;
+    memcpy(out, events, game_events_size(events->capacity));
+}
+
+void game_events_set(GameEvents *events, int index, PlayerEvent event)
+{
+    // Events go through here so event_count stays correct
+    PlayerEvent *current = &events->players[index].event;
+    events->event_count += (event != PLAYER_EVENT_NONE) - (*current != PLAYER_EVENT_NONE);
+    *current = event;
+}
+
+bool game_events_idle(const GameEvents *events, const GameState *state)
+{
+    // Whether simulating the events from the state would leave it unchanged
+    // Only active players move so their inputs are the only ones that matter
+    if (events->event_count > 0) return false;
+
+    const uint16_t *slots = game_state_active_slots(state);
+    for (int k = 0; k < state->active_count; ++k)
+    {
+        const bool *held = events->players[slots[k]].input.movements_held;
+        if (held[0] || held[1] || held[2] || held[3]) return false;
+    }
+    return true;
+}
+
+bool game_events_match(const GameEvents *a, const GameEvents *b, const GameState *state)
+{
+    // Whether simulating the state with either set of events gives the same result
+    // Every event has to match, inputs only for the players that are or become active
+    if (a->event_count != b->event_count) return false;
+    for (int i = 0; i < state->capacity; ++i)
+    {
+        const PlayerFrame *pa = &a->players[i];
+        const PlayerFrame *pb = &b->players[i];
+        if (pa->event != pb->event) return false;
+        if (pa->event == PLAYER_EVENT_ENTER && (pa->x != pb->x || pa->y != pb->y)) return false;
+        if (!state->player_data[i].active && pa->event != PLAYER_EVENT_JOIN && pa->event != PLAYER_EVENT_ENTER) continue;
+        if (memcmp(pa->input.movements_held, pb->input.movements_held, sizeof(pa->input.movements_held)) != 0) return false;
+    }
+    return true;
+}
+
+static void game_simulate_event(GameState *state, const PlayerFrame *player_frame, int index)
+{
+    PlayerData *player_data = &state->player_data[index];
+    PlayerEvent player_event = player_frame->event;
+
+    if (player_event == PLAYER_EVENT_JOIN)
+    {
+        game_state_set_active(state, index, true);
+        player_data->x = PLAYER_SPAWN_POS;
+        player_data->y = PLAYER_SPAWN_POS;
+        log_printf("Spawning player %d\n", index);
+    }
+    if (player_event == PLAYER_EVENT_ENTER)
+    {
+        game_state_set_active(state, index, true);
+        player_data->x = player_frame->x;
+        player_data->y = player_frame->y;
+    }
+    if (player_event == PLAYER_EVENT_LEAVE || player_event == PLAYER_EVENT_EXIT)
+    {
+        game_state_set_active(state, index, false);
+    }
+}
+
+static bool game_simulate_movement(PlayerData *player_data, const PlayerInput *player_input, const SpatialHash *grid, int index)
+{
+    // Returns whether the player was written to at all
+    // Each axis is checked against where everyone was before anyone moved, so the
+    // order players move in never changes the result. x is checked first then y from there
+    const bool *held = player_input->movements_held;
+    if (!(held[0] || held[1] || held[2] || held[3])) return false;
+
+    game_pos_t x = player_data->x;
+    game_pos_t y = player_data->y;
+    game_pos_t to_x = x;
+    game_pos_t to_y = y;
+    if (held[0]) to_x -= PLAYER_SPEED;
+    if (held[1]) to_x += PLAYER_SPEED;
+    if (held[2]) to_y -= PLAYER_SPEED;
+    if (held[3]) to_y += PLAYER_SPEED;
+
+    if (to_x != x && spatial_hash_blocked(grid, index, x, y, to_x, y)) to_x = x;
+    if (to_y != y && spatial_hash_blocked(grid, index, to_x, y, to_x, to_y)) to_y = y;
+    player_data->x = to_x;
+    player_data->y = to_y;
+    return true;
+}
 
-        if (!player_data->active) continue;
+static SpatialHash *game_collision_grid(void)
+{
+    // Broad phase buffers for game_simulate(), one per thread so simulations on different
+    // threads never share them. Kept for the life of the thread, only the contents change
+    static _Thread_local SpatialHash grid;
+    return &grid;
+}
+
+void game_collision_build(SpatialHash *grid, const GameState *state)
+{
+    // Snapshot every active players position before movement
+    // Without room for it collisions would silently be skipped and desync, so give up instead
+    if (spatial_hash_reserve(grid, state->capacity) != 0) abort();
 
-        // Handle movement
-        if (player_input->movements_held[0]) player_data->x -= 1.0f;
-        if (player_input->movements_held[1]) player_data->x += 1.0f;
-        if (player_input->movements_held[2]) player_data->y -= 1.0f;
-        if (player_input->movements_held[3]) player_data->y += 1.0f;
+    const uint16_t *slots = game_state_active_slots(state);
+    spatial_hash_begin(grid);
+    for (int k = 0; k < state->active_count; ++k)
+    {
+        const PlayerData *player_data = &state->player_data[slots[k]];
+        spatial_hash_add(grid, slots[k], player_data->x, player_data->y);
+    }
+    spatial_hash_end(grid);
+}
+
+void game_simulate(const GameState *current, const GameEvents *events, GameState *out)
+{
+    SpatialHash *grid = game_collision_grid();
+    game_state_copy(out, current);
+    game_simulate_events(out, events);
+    game_collision_build(grid, out);
+    game_simulate_movements(out, events, grid, 0, out->active_count);
+}
+
+void game_simulate_events(GameState *state, const GameEvents *events)
+{
+    // Handle events, the only thing that changes which players are active
+    for (int i = 0, found = 0; found < events->event_count; ++i)
+    {
+        if (events->players[i].event == PLAYER_EVENT_NONE) continue;
+        game_simulate_event(state, &events->players[i], i);
+        found++;
+    }
+}
+
+void game_simulate_movements(GameState *state, const GameEvents *events, const SpatialHash *grid, int first, int last)
+{
+    // Handle movement of the active players in [first, last) of the active list
+    // Each player only writes itself and collides against the grid built by game_collision_build()
+    // before any movement, so disjoint ranges can run at the same time
+    const uint16_t *slots = game_state_active_slots(state);
+    for (int k = first; k < last; ++k)
+    {
+        int i = slots[k];
+        game_simulate_movement(&state->player_data[i], &events->players[i].input, grid, i);
+    }
+}
+
+int game_simulate_logged(GameState *state, const GameEvents *events, PlayerUndo *undo_log)
+{
+    // Simulate in place, recording the previous value of each player that was written
+    // A player is logged at most once so the log needs room for capacity entries
+    int undo_count = 0;
+    for (int i = 0, found = 0; found < events->event_count; ++i)
+    {
+        if (events->players[i].event == PLAYER_EVENT_NONE) continue;
+        undo_log[undo_count].index = i;
+        undo_log[undo_count].before = state->player_data[i];
+        undo_count++;
+        game_simulate_event(state, &events->players[i], i);
+        found++;
+    }
+
+    SpatialHash *grid = game_collision_grid();
+    game_collision_build(grid, state);
+
+    const uint16_t *slots = game_state_active_slots(state);
+    for (int k = 0; k < state->active_count; ++k)
+    {
+        int i = slots[k];
+        PlayerData before = state->player_data[i];
+        if (game_simulate_movement(&state->player_data[i], &events->players[i].input, grid, i) &&
+            events->players[i].event == PLAYER_EVENT_NONE)
+        {
+            undo_log[undo_count].index = i;
+            undo_log[undo_count].before = before;
+            undo_count++;
+        }
+    }
+    return undo_count;
+}
+
+void game_undo(GameState *state, const PlayerUndo *undo_log, int undo_count)
+{
+    // Restore a frame simulated with game_simulate_logged(), newest entry first
+    for (int i = undo_count - 1; i >= 0; --i)
+    {
+        int index = undo_log[i].index;
+        game_state_set_active(state, index, undo_log[i].before.active);
+        state->player_data[index] = undo_log[i].before;
     }
 }
@@ -2,6 +2,7 @@
 
 #include "../shared/globals.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -10,28 +11,95 @@ typedef struct
     bool movements_held[4];
 } PlayerInput;
 
+// With GAME_FIXED_POINT positions are 16.16 fixed point so the simulation is integer only
+// and bit identical across compilers, optimisation levels and FMA contraction
+#if GAME_FIXED_POINT
+typedef int32_t game_pos_t;
+#define GAME_POS_ONE 65536
+#else
+typedef float game_pos_t;
+#define GAME_POS_ONE 1.0f
+#endif
+
+#define GAME_POS(value) ((game_pos_t)((value) * GAME_POS_ONE))
+#define GAME_POS_TO_FLOAT(pos) ((float)(pos) / GAME_POS_ONE)
+
+#define PLAYER_SPAWN_POS GAME_POS(400)
+#define PLAYER_SPEED GAME_POS(1)
+#define PLAYER_RADIUS GAME_POS(20)
+
+typedef struct SpatialHash SpatialHash;
+
+// ENTER and EXIT are only sent to clients, a player coming into or going out of what they are
+// sent rather than joining or leaving the game. ENTER places the player at the frames x, y
 typedef enum class
 {
     PLAYER_EVENT_NONE,
     PLAYER_EVENT_JOIN,
-    PLAYER_EVENT_LEAVE
+    PLAYER_EVENT_LEAVE,
+    PLAYER_EVENT_ENTER,
+    PLAYER_EVENT_EXIT
 } PlayerEvent;
 
 typedef struct
 {
-    PlayerEvent player_events[MAX_CLIENTS];
-    PlayerInput player_inputs[MAX_CLIENTS];
+    PlayerEvent event;
+    PlayerInput input;
+    game_pos_t x, y;
+} PlayerFrame;
+
+// Everything that happens in a frame, one PlayerFrame per client slot
+// event_count is how many slots have an event so frames without any skip looking
+typedef struct
+{
+    int capacity;
+    int event_count;
+    PlayerFrame players[];
 } GameEvents;
 
 typedef struct
 {
-    float x, y;
+    game_pos_t x, y;
     bool active;
 } PlayerData;
 
+// State of every client slot, followed in memory by the active slots in ascending order
+// so the simulation only visits connected players. Both are sized by capacity at runtime
+// so states are always allocated with game_state_size() and copied with game_state_copy()
 typedef struct
 {
-    PlayerData player_data[MAX_CLIENTS];
+    int capacity;
+    int active_count;
+    PlayerData player_data[];
 } GameState;
 
+typedef struct
+{
+    int index;
+    PlayerData before;
+} PlayerUndo;
+
+size_t game_state_size(int capacity);
+GameState *game_state_alloc(int capacity);
+void game_state_init(GameState *state, int capacity);
+void game_state_copy(GameState *out, const GameState *state);
+uint16_t *game_state_active_slots(const GameState *state);
+void game_state_rebuild_active(GameState *state);
+uint32_t game_state_hash(const GameState *state);
+uint32_t game_state_hash_slots(const GameState *state, const uint16_t *slots, int count);
+
+size_t game_events_size(int capacity);
+GameEvents *game_events_alloc(int capacity);
+void game_events_init(GameEvents *events, int capacity);
+void game_events_clear(GameEvents *events);
+void game_events_copy(GameEvents *out, const GameEvents *events);
+void game_events_set(GameEvents *events, int index, PlayerEvent event);
+bool game_events_idle(const GameEvents *events, const GameState *state);
+bool game_events_match(const GameEvents *a, const GameEvents *b, const GameState *state);
+
 void game_simulate(const GameState *current, const GameEvents *input, GameState *out);
+void game_simulate_events(GameState *state, const GameEvents *events);
+void game_simulate_movements(GameState *state, const GameEvents *events, const SpatialHash *grid, int first, int last);
+void game_collision_build(SpatialHash *grid, const GameState *state);
+int game_simulate_logged(GameState *state, const GameEvents *events, PlayerUndo *undo_log);
+void game_undo(GameState *state, const PlayerUndo *undo_log, int undo_count);
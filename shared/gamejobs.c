@@ -0,0 +1,120 @@
+#include "gamejobs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void game_jobs_run(GameJobPool *pool, int index)
+{
+    // Equal contiguous share of the active list, empty if there are more threads than jobs
+    if (index >= pool->job_count) return;
+    int active_count = pool->state->active_count;
+    int first = (int)((long long)active_count * index / pool->job_count);
+    int last = (int)((long long)active_count * (index + 1) / pool->job_count);
+    game_simulate_movements(pool->state, pool->events, &pool->grid, first, last);
+}
+
+static void *game_jobs_worker_thread(void *arg)
+{
+    GameJobWorker *worker = (GameJobWorker *)arg;
+    GameJobPool *pool = worker->pool;
+    unsigned int seen_generation = 0;
+
+    // Sleep until the next frame is dispatched, run this workers job then report back
+    pthread_mutex_lock(&pool->lock);
+    while (true)
+    {
+        while (!pool->to_shutdown && pool->generation == seen_generation) pthread_cond_wait(&pool->start_cond, &pool->lock);
+        if (pool->to_shutdown) break;
+        seen_generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        game_jobs_run(pool, worker->index);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) pthread_cond_signal(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int game_jobs_init(GameJobPool *pool, int thread_count)
+{
+    // The calling thread runs job 0 so only thread_count - 1 workers are started
+    memset(pool, 0, sizeof(*pool));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    pool->thread_count = thread_count < 1 ? 1 : thread_count;
+
+    pool->workers = calloc(pool->thread_count, sizeof(GameJobWorker));
+    if (pool->workers == NULL)
+    {
+        perror("calloc()");
+        game_jobs_free(pool);
+        return 1;
+    }
+
+    for (int i = 1; i < pool->thread_count; ++i)
+    {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        if (pthread_create(&pool->workers[i].thread, NULL, game_jobs_worker_thread, &pool->workers[i]) != 0)
+        {
+            perror("pthread_create() game_jobs_worker_thread");
+            game_jobs_free(pool);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void game_jobs_free(GameJobPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->to_shutdown = true;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; pool->workers != NULL && i < pool->thread_count; ++i)
+    {
+        if (pool->workers[i].thread) pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    free(pool->workers);
+    pool->workers = NULL;
+    spatial_hash_free(&pool->grid);
+}
+
+void game_simulate_parallel(GameJobPool *pool, const GameState *current, const GameEvents *events, GameState *out)
+{
+    game_state_copy(out, current);
+    game_simulate_events(out, events);
+    game_collision_build(&pool->grid, out);
+
+    // Small frames are simulated serially rather than paying for the wake ups
+    int job_count = out->active_count / GAME_JOBS_MIN_PLAYERS;
+    if (job_count > pool->thread_count) job_count = pool->thread_count;
+    if (job_count <= 1)
+    {
+        game_simulate_movements(out, events, &pool->grid, 0, out->active_count);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->job_count = job_count;
+    pool->state = out;
+    pool->events = events;
+    pool->pending = pool->thread_count - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    game_jobs_run(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) pthread_cond_wait(&pool->done_cond, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "gameimpl.h"
+#include "spatialhash.h"
+#include <pthread.h>
+#include <stdbool.h>
+
+// Persistent pool of worker threads that game_simulate_parallel() splits a frame across
+//
+// Events are applied first on the calling thread in slot order as they change the active list,
+// then the collision grid is built from everyones position. Movement is split into contiguous
+// ranges of the active list, one per job, each player only writes itself and collides against
+// the grid. So the result is bit identical to game_simulate() for any number of threads.
+
+// Fewer active players than this per job and the frame is not worth waking workers for
+#define GAME_JOBS_MIN_PLAYERS 1024
+
+typedef struct GameJobPool GameJobPool;
+
+typedef struct
+{
+    GameJobPool *pool;
+    int index;
+    pthread_t thread;
+} GameJobWorker;
+
+struct GameJobPool
+{
+    int thread_count;
+    GameJobWorker *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    unsigned int generation;
+    int pending;
+    bool to_shutdown;
+
+    int job_count;
+    SpatialHash grid;
+    GameState *state;
+    const GameEvents *events;
+};
+
+int game_jobs_init(GameJobPool *pool, int thread_count);
+void game_jobs_free(GameJobPool *pool);
+
+void game_simulate_parallel(GameJobPool *pool, const GameState *current, const GameEvents *events, GameState *out);
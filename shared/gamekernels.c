@@ -0,0 +1,113 @@
+#include "gamekernels.h"
+#include "log.h"
+
+static inline __attribute__((always_inline)) bool game_kernel_blocked(const double *xs, const double *ys, const int *active, const int capacity, int id,
+                                                                      double along, double across, double to_along, bool along_x)
+{
+    // spatial_hash_blocked() for a move along one axis against every slot, inactive ones and
+    // id itself masked out
+    const double *along_pos = along_x ? xs : ys;
+    const double *across_pos = along_x ? ys : xs;
+    int blocked = 0;
+    for (int j = 0; j < capacity; ++j)
+    {
+        blocked |= active[j] & (j != id) & game_kernel_pair_blocked(along, across, to_along, along_pos[j], across_pos[j]);
+    }
+    return blocked;
+}
+
+static inline __attribute__((always_inline)) void game_kernel_events(GameState *state, const GameEvents *events, const int capacity)
+{
+    // Same rules as game_simulate_event() as selects over every slot
+    PlayerData *players = state->player_data;
+    for (int i = 0; i < capacity; ++i)
+    {
+        const PlayerFrame *frame = &events->players[i];
+        bool join = frame->event == PLAYER_EVENT_JOIN;
+        bool enter = frame->event == PLAYER_EVENT_ENTER;
+        bool leave = frame->event == PLAYER_EVENT_LEAVE || frame->event == PLAYER_EVENT_EXIT;
+        players[i].x = join ? PLAYER_SPAWN_POS : enter ? frame->x : players[i].x;
+        players[i].y = join ? PLAYER_SPAWN_POS : enter ? frame->y : players[i].y;
+        players[i].active = (players[i].active | join | enter) & !leave;
+    }
+    for (int i = 0; i < capacity; ++i)
+    {
+        if (events->players[i].event == PLAYER_EVENT_JOIN) log_printf("Spawning player %d\n", i);
+    }
+}
+
+static inline __attribute__((always_inline)) void game_kernel_simulate_fixed(const GameState *current, const GameEvents *events, GameState *out, const int capacity)
+{
+    // Every slot is copied so each one has a position to read, inactive ones just never move
+    if (out->capacity != capacity)
+    {
+        game_state_copy(out, current);
+    }
+    else if (out != current)
+    {
+        memcpy(out->player_data, current->player_data, capacity * sizeof(PlayerData));
+    }
+    PlayerData *players = out->player_data;
+    if (events->event_count > 0) game_kernel_events(out, events, capacity);
+
+    // Rebuilding the active list is cheaper than keeping it sorted through the events
+    uint16_t *slots = game_state_active_slots(out);
+    int active_count = 0;
+    for (int i = 0; i < capacity; ++i)
+    {
+        slots[active_count] = (uint16_t)i;
+        active_count += players[i].active;
+    }
+    out->active_count = active_count;
+
+    // Where everyone is before anyone moves, what every collision is checked against
+    // As doubles once here rather than for every pair, exact for either kind of game_pos_t
+    double from_x[capacity], from_y[capacity];
+    int active[capacity];
+    for (int i = 0; i < capacity; ++i)
+    {
+        from_x[i] = players[i].x;
+        from_y[i] = players[i].y;
+        active[i] = players[i].active;
+    }
+
+    // Same steps as game_simulate_movement() so float positions round the same way
+    for (int i = 0; i < capacity; ++i)
+    {
+        const bool *held = events->players[i].input.movements_held;
+        game_pos_t x = players[i].x;
+        game_pos_t y = players[i].y;
+        game_pos_t to_x = x;
+        game_pos_t to_y = y;
+        to_x = held[0] ? to_x - PLAYER_SPEED : to_x;
+        to_x = held[1] ? to_x + PLAYER_SPEED : to_x;
+        to_y = held[2] ? to_y - PLAYER_SPEED : to_y;
+        to_y = held[3] ? to_y + PLAYER_SPEED : to_y;
+
+        to_x = game_kernel_blocked(from_x, from_y, active, capacity, i, x, y, to_x, true) ? x : to_x;
+        to_y = game_kernel_blocked(from_x, from_y, active, capacity, i, y, to_x, to_y, false) ? y : to_y;
+        players[i].x = active[i] ? to_x : x;
+        players[i].y = active[i] ? to_y : y;
+    }
+}
+
+#define GAME_KERNEL_SIMULATE(capacity)                                                                   \
+    static void game_kernel_simulate_##capacity(const GameState *current, const GameEvents *events, GameState *out) \
+    {                                                                                                    \
+        game_kernel_simulate_fixed(current, events, out, capacity);                                      \
+    }
+GAME_KERNEL_CAPACITIES(GAME_KERNEL_SIMULATE)
+
+GameSimulateKernel game_kernel_simulate(int capacity)
+{
+    // The kernel for a capacity or NULL if there is none or they were built without
+    if (!GAME_KERNELS) return NULL;
+    switch (capacity)
+    {
+#define GAME_KERNEL_SIMULATE_CASE(capacity) \
+    case capacity:                          \
+        return game_kernel_simulate_##capacity;
+        GAME_KERNEL_CAPACITIES(GAME_KERNEL_SIMULATE_CASE)
+    }
+    return NULL;
+}
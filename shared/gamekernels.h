@@ -0,0 +1,44 @@
+#pragma once
+
+#include "gameimpl.h"
+#include <stdbool.h>
+
+// game_simulate() specialised for a few fixed capacities
+//
+// Each kernel is the generic code with the capacity as a compile time constant, and goes
+// over every slot without branching on which are active, so the compiler can unroll and
+// vectorise it. Collisions test every other slot rather than building the spatial hash,
+// which stops paying off past 64 slots. The results are identical to game_simulate().
+// game_simulate() never calls them. They only win in a nearly full room at a capacity with a
+// kernel, which the server and client never run, so they are only built with GAME_KERNELS 1
+// as bench does to measure them. game_kernel_pair_blocked() is shared with the SoA collisions
+
+#define GAME_KERNEL_CAPACITIES(X) X(8) X(16) X(64)
+
+// spatial_hash_blocked() for one body and a move along one axis, for testing every pair
+// branch free. Positions are taken as doubles, exact for either kind of game_pos_t, so callers
+// testing many pairs can convert them once. In fixed point the squares are exact for anything
+// closer than touching and never rounded below it for anything further, and only the axis
+// moved along changes so nearer is just a smaller difference on it. Float squares are the
+// same doubles as the hash
+static inline __attribute__((always_inline)) int game_kernel_pair_blocked(double along, double across, double to_along, double body_along, double body_across)
+{
+#if GAME_FIXED_POINT
+    const double touching = (double)(2 * PLAYER_RADIUS) * (double)(2 * PLAYER_RADIUS);
+    double to_d = to_along - body_along;
+    double from_d = along - body_along;
+    double across_d = across - body_across;
+    return (to_d * to_d + across_d * across_d < touching) & (to_d * to_d < from_d * from_d);
+#else
+    const double diameter = (double)(2 * PLAYER_RADIUS);
+    double to_d = to_along - body_along;
+    double from_d = along - body_along;
+    double across_d = across - body_across;
+    double to_dist2 = to_d * to_d + across_d * across_d;
+    return (to_dist2 < diameter * diameter) & (to_dist2 < from_d * from_d + across_d * across_d);
+#endif
+}
+
+typedef void (*GameSimulateKernel)(const GameState *current, const GameEvents *events, GameState *out);
+
+GameSimulateKernel game_kernel_simulate(int capacity);
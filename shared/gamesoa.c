@@ -0,0 +1,395 @@
+#include "gamesoa.h"
+#include "gamekernels.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+enum
+{
+    INPUT_LEFT = 1 << 0,
+    INPUT_RIGHT = 1 << 1,
+    INPUT_UP = 1 << 2,
+    INPUT_DOWN = 1 << 3,
+};
+
+static int game_soa_padded(int count)
+{
+    return (count + SOA_LANES - 1) / SOA_LANES * SOA_LANES;
+}
+
+static void *game_soa_alloc(size_t size)
+{
+    // 32 byte aligned for AVX, size rounded up to match as aligned_alloc requires
+    void *memory = aligned_alloc(32, (size + 31) / 32 * 32);
+    if (memory != NULL) memset(memory, 0, size);
+    return memory;
+}
+
+int game_soa_init(GameStateSoA *state, GameEventsSoA *events, int count)
+{
+    int padded = game_soa_padded(count);
+    state->count = count;
+    state->x = game_soa_alloc(padded * sizeof(game_pos_t));
+    state->y = game_soa_alloc(padded * sizeof(game_pos_t));
+    state->active = game_soa_alloc(padded / 8);
+    events->count = count;
+    events->events = game_soa_alloc(padded);
+    events->inputs = game_soa_alloc(padded);
+
+    if (!state->x || !state->y || !state->active || !events->events || !events->inputs)
+    {
+        perror("aligned_alloc()");
+        game_soa_free(state, events);
+        return 1;
+    }
+    return 0;
+}
+
+void game_soa_free(GameStateSoA *state, GameEventsSoA *events)
+{
+    free(state->x);
+    free(state->y);
+    free(state->active);
+    free(events->events);
+    free(events->inputs);
+    memset(state, 0, sizeof(*state));
+    memset(events, 0, sizeof(*events));
+}
+
+void game_soa_load_state(GameStateSoA *state, int offset, const GameState *source)
+{
+    game_soa_load_state_strided(state, offset, 1, source);
+}
+
+void game_soa_store_state(const GameStateSoA *state, int offset, GameState *out)
+{
+    game_soa_store_state_strided(state, offset, 1, out);
+}
+
+void game_soa_load_events(GameEventsSoA *events, int offset, const GameEvents *source)
+{
+    game_soa_load_events_strided(events, offset, 1, source);
+}
+
+void game_soa_load_state_strided(GameStateSoA *state, int offset, int stride, const GameState *source)
+{
+    // Player i goes to offset + i * stride
+    for (int i = 0; i < source->capacity; ++i)
+    {
+        int j = offset + i * stride;
+        const PlayerData *player = &source->player_data[i];
+        state->x[j] = player->x;
+        state->y[j] = player->y;
+        if (player->active) state->active[j / 8] |= (uint8_t)(1 << (j % 8));
+        else state->active[j / 8] &= (uint8_t)~(1 << (j % 8));
+    }
+}
+
+void game_soa_store_state_strided(const GameStateSoA *state, int offset, int stride, GameState *out)
+{
+    for (int i = 0; i < out->capacity; ++i)
+    {
+        int j = offset + i * stride;
+        PlayerData *player = &out->player_data[i];
+        player->x = state->x[j];
+        player->y = state->y[j];
+        player->active = (state->active[j / 8] >> (j % 8)) & 1;
+    }
+    game_state_rebuild_active(out);
+}
+
+void game_soa_load_events_strided(GameEventsSoA *events, int offset, int stride, const GameEvents *source)
+{
+    for (int i = 0; i < source->capacity; ++i)
+    {
+        int j = offset + i * stride;
+        const bool *held = source->players[i].input.movements_held;
+        assert(source->players[i].event <= PLAYER_EVENT_LEAVE);
+        events->events[j] = (uint8_t)source->players[i].event;
+        events->inputs[j] = (held[0] ? INPUT_LEFT : 0) | (held[1] ? INPUT_RIGHT : 0) |
+                                     (held[2] ? INPUT_UP : 0) | (held[3] ? INPUT_DOWN : 0);
+    }
+}
+
+static inline __attribute__((always_inline)) void game_soa_collide_lanes(GameStateSoA *state, const GameEventsSoA *events, const game_pos_t *from_x,
+                                                                         const game_pos_t *from_y, int first, int world_step, int stride,
+                                                                         const int capacity, const int lanes)
+{
+    // lanes worlds side by side, every step of every pair test goes across them so it vectorises
+    // Everyone collides against where they were after events, joining players start at spawn
+    double body_x[capacity][lanes], body_y[capacity][lanes];
+    int body_active[capacity][lanes];
+    for (int j = 0; j < capacity; ++j)
+    {
+        for (int l = 0; l < lanes; ++l)
+        {
+            int k = first + l * world_step + j * stride;
+            bool joined = events->events[k] == PLAYER_EVENT_JOIN;
+            body_x[j][l] = joined ? PLAYER_SPAWN_POS : from_x[k];
+            body_y[j][l] = joined ? PLAYER_SPAWN_POS : from_y[k];
+            body_active[j][l] = (state->active[k / 8] >> (k % 8)) & 1;
+        }
+    }
+
+    // Undo each axis of the kernels move that is blocked, x first then y from there
+    // A player that did not move along an axis is never nearer so never blocked
+    for (int i = 0; i < capacity; ++i)
+    {
+        double to_x[lanes], to_y[lanes];
+        int blocked[lanes];
+        for (int l = 0; l < lanes; ++l)
+        {
+            int k = first + l * world_step + i * stride;
+            to_x[l] = state->x[k];
+            to_y[l] = state->y[k];
+            blocked[l] = 0;
+        }
+        for (int j = 0; j < capacity; ++j)
+        {
+            if (j == i) continue;
+            for (int l = 0; l < lanes; ++l)
+            {
+                blocked[l] |= body_active[j][l] & game_kernel_pair_blocked(body_x[i][l], body_y[i][l], to_x[l], body_x[j][l], body_y[j][l]);
+            }
+        }
+        for (int l = 0; l < lanes; ++l)
+        {
+            to_x[l] = blocked[l] & body_active[i][l] ? body_x[i][l] : to_x[l];
+            blocked[l] = 0;
+        }
+        for (int j = 0; j < capacity; ++j)
+        {
+            if (j == i) continue;
+            for (int l = 0; l < lanes; ++l)
+            {
+                blocked[l] |= body_active[j][l] & game_kernel_pair_blocked(body_y[i][l], to_x[l], to_y[l], body_y[j][l], body_x[j][l]);
+            }
+        }
+        for (int l = 0; l < lanes; ++l)
+        {
+            int k = first + l * world_step + i * stride;
+            state->x[k] = (game_pos_t)to_x[l];
+            state->y[k] = (game_pos_t)(blocked[l] & body_active[i][l] ? body_y[i][l] : to_y[l]);
+        }
+    }
+}
+
+void game_soa_collide(GameStateSoA *state, const GameEventsSoA *events, const game_pos_t *from_x, const game_pos_t *from_y, int world_step, int stride,
+                      int capacity, int world_count)
+{
+    // Same rule as game_simulate() for world_count worlds of capacity players, player i of world
+    // w at w * world_step + i * stride. Every pair is tested like the kernels rather than hashed
+    // as that is cheaper for rooms this small, SOA_LANES worlds at a time
+    int w = 0;
+    for (; w + SOA_LANES <= world_count; w += SOA_LANES)
+    {
+        game_soa_collide_lanes(state, events, from_x, from_y, w * world_step, world_step, stride, capacity, SOA_LANES);
+    }
+    for (; w < world_count; ++w)
+    {
+        game_soa_collide_lanes(state, events, from_x, from_y, w * world_step, world_step, stride, capacity, 1);
+    }
+}
+
+void game_simulate_soa(GameStateSoA *state, const GameEventsSoA *events)
+{
+    // Pick the widest kernel this build was compiled for
+#if defined(__AVX2__)
+    game_simulate_soa_avx2(state, events);
+#elif defined(__SSE2__)
+    game_simulate_soa_sse2(state, events);
+#else
+    game_simulate_soa_scalar(state, events);
+#endif
+}
+
+void game_simulate_soa_scalar(GameStateSoA *state, const GameEventsSoA *events)
+{
+    // Same steps as game_simulate() so results are bit identical, minus the spawn logging
+    for (int i = 0; i < state->count; ++i)
+    {
+        uint8_t bit = (uint8_t)(1 << (i % 8));
+        bool active = state->active[i / 8] & bit;
+
+        if (events->events[i] == PLAYER_EVENT_JOIN)
+        {
+            active = true;
+            state->x[i] = PLAYER_SPAWN_POS;
+            state->y[i] = PLAYER_SPAWN_POS;
+        }
+        if (events->events[i] == PLAYER_EVENT_LEAVE) active = false;
+
+        if (active) state->active[i / 8] |= bit;
+        else state->active[i / 8] &= (uint8_t)~bit;
+        if (!active) continue;
+
+        uint8_t input = events->inputs[i];
+        if (input & INPUT_LEFT) state->x[i] -= PLAYER_SPEED;
+        if (input & INPUT_RIGHT) state->x[i] += PLAYER_SPEED;
+        if (input & INPUT_UP) state->y[i] -= PLAYER_SPEED;
+        if (input & INPUT_DOWN) state->y[i] += PLAYER_SPEED;
+    }
+}
+
+#ifdef __SSE2__
+// Position lanes are kept as __m128 for either representation so the kernels are shared
+// Fixed point reinterprets them as 32 bit ints for the arithmetic
+static __m128 pos_set1(game_pos_t value)
+{
+#if GAME_FIXED_POINT
+    return _mm_castsi128_ps(_mm_set1_epi32(value));
+#else
+    return _mm_set1_ps(value);
+#endif
+}
+
+static __m128 pos_add(__m128 a, __m128 b)
+{
+#if GAME_FIXED_POINT
+    return _mm_castsi128_ps(_mm_add_epi32(_mm_castps_si128(a), _mm_castps_si128(b)));
+#else
+    return _mm_add_ps(a, b);
+#endif
+}
+
+static __m128 pos_sub(__m128 a, __m128 b)
+{
+#if GAME_FIXED_POINT
+    return _mm_castsi128_ps(_mm_sub_epi32(_mm_castps_si128(a), _mm_castps_si128(b)));
+#else
+    return _mm_sub_ps(a, b);
+#endif
+}
+
+static __m128 select_ps(__m128 mask, __m128 a, __m128 b)
+{
+    // mask ? a : b per lane
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static __m128i key_mask(__m128i input, __m128i active, int key)
+{
+    __m128i bit = _mm_set1_epi32(key);
+    return _mm_and_si128(active, _mm_cmpeq_epi32(_mm_and_si128(input, bit), bit));
+}
+
+void game_simulate_soa_sse2(GameStateSoA *state, const GameEventsSoA *events)
+{
+    // 4 players per step, every branch of the scalar kernel becomes a lane mask
+    // Moves are selected rather than added as 0 so signed zeros stay identical
+    const __m128i lane_bits = _mm_setr_epi32(1, 2, 4, 8);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 speed = pos_set1(PLAYER_SPEED);
+    const __m128 spawn = pos_set1(PLAYER_SPAWN_POS);
+
+    int padded = game_soa_padded(state->count);
+    for (int i = 0; i < padded; i += 4)
+    {
+        int shift = i % 8;
+        uint8_t *active_byte = &state->active[i / 8];
+        __m128i active_bits = _mm_set1_epi32((*active_byte >> shift) & 0xF);
+        __m128i active = _mm_cmpeq_epi32(_mm_and_si128(active_bits, lane_bits), lane_bits);
+
+        // Widen 4 bytes of events and inputs to 4 ints
+        int32_t event_bytes, input_bytes;
+        memcpy(&event_bytes, &events->events[i], 4);
+        memcpy(&input_bytes, &events->inputs[i], 4);
+        __m128i event = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(event_bytes), zero), zero);
+        __m128i input = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(input_bytes), zero), zero);
+
+        __m128i join = _mm_cmpeq_epi32(event, _mm_set1_epi32(PLAYER_EVENT_JOIN));
+        __m128i leave = _mm_cmpeq_epi32(event, _mm_set1_epi32(PLAYER_EVENT_LEAVE));
+        active = _mm_andnot_si128(leave, _mm_or_si128(active, join));
+
+        __m128 x = _mm_loadu_ps((const float *)&state->x[i]);
+        __m128 y = _mm_loadu_ps((const float *)&state->y[i]);
+        x = select_ps(_mm_castsi128_ps(join), spawn, x);
+        y = select_ps(_mm_castsi128_ps(join), spawn, y);
+
+        x = select_ps(_mm_castsi128_ps(key_mask(input, active, INPUT_LEFT)), pos_sub(x, speed), x);
+        x = select_ps(_mm_castsi128_ps(key_mask(input, active, INPUT_RIGHT)), pos_add(x, speed), x);
+        y = select_ps(_mm_castsi128_ps(key_mask(input, active, INPUT_UP)), pos_sub(y, speed), y);
+        y = select_ps(_mm_castsi128_ps(key_mask(input, active, INPUT_DOWN)), pos_add(y, speed), y);
+
+        _mm_storeu_ps((float *)&state->x[i], x);
+        _mm_storeu_ps((float *)&state->y[i], y);
+        int active_mask = _mm_movemask_ps(_mm_castsi128_ps(active));
+        *active_byte = (uint8_t)((*active_byte & ~(0xF << shift)) | (active_mask << shift));
+    }
+}
+#endif
+
+#ifdef __AVX2__
+static __m256 pos_set1_avx2(game_pos_t value)
+{
+#if GAME_FIXED_POINT
+    return _mm256_castsi256_ps(_mm256_set1_epi32(value));
+#else
+    return _mm256_set1_ps(value);
+#endif
+}
+
+static __m256 pos_add_avx2(__m256 a, __m256 b)
+{
+#if GAME_FIXED_POINT
+    return _mm256_castsi256_ps(_mm256_add_epi32(_mm256_castps_si256(a), _mm256_castps_si256(b)));
+#else
+    return _mm256_add_ps(a, b);
+#endif
+}
+
+static __m256 pos_sub_avx2(__m256 a, __m256 b)
+{
+#if GAME_FIXED_POINT
+    return _mm256_castsi256_ps(_mm256_sub_epi32(_mm256_castps_si256(a), _mm256_castps_si256(b)));
+#else
+    return _mm256_sub_ps(a, b);
+#endif
+}
+
+static __m256i key_mask_avx2(__m256i input, __m256i active, int key)
+{
+    __m256i bit = _mm256_set1_epi32(key);
+    return _mm256_and_si256(active, _mm256_cmpeq_epi32(_mm256_and_si256(input, bit), bit));
+}
+
+void game_simulate_soa_avx2(GameStateSoA *state, const GameEventsSoA *events)
+{
+    // 8 players per step, so one byte of the active bitmask at a time
+    const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256 speed = pos_set1_avx2(PLAYER_SPEED);
+    const __m256 spawn = pos_set1_avx2(PLAYER_SPAWN_POS);
+
+    int padded = game_soa_padded(state->count);
+    for (int i = 0; i < padded; i += 8)
+    {
+        __m256i active_bits = _mm256_set1_epi32(state->active[i / 8]);
+        __m256i active = _mm256_cmpeq_epi32(_mm256_and_si256(active_bits, lane_bits), lane_bits);
+
+        __m256i event = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)&events->events[i]));
+        __m256i input = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)&events->inputs[i]));
+
+        __m256i join = _mm256_cmpeq_epi32(event, _mm256_set1_epi32(PLAYER_EVENT_JOIN));
+        __m256i leave = _mm256_cmpeq_epi32(event, _mm256_set1_epi32(PLAYER_EVENT_LEAVE));
+        active = _mm256_andnot_si256(leave, _mm256_or_si256(active, join));
+
+        __m256 x = _mm256_loadu_ps((const float *)&state->x[i]);
+        __m256 y = _mm256_loadu_ps((const float *)&state->y[i]);
+        x = _mm256_blendv_ps(x, spawn, _mm256_castsi256_ps(join));
+        y = _mm256_blendv_ps(y, spawn, _mm256_castsi256_ps(join));
+
+        x = _mm256_blendv_ps(x, pos_sub_avx2(x, speed), _mm256_castsi256_ps(key_mask_avx2(input, active, INPUT_LEFT)));
+        x = _mm256_blendv_ps(x, pos_add_avx2(x, speed), _mm256_castsi256_ps(key_mask_avx2(input, active, INPUT_RIGHT)));
+        y = _mm256_blendv_ps(y, pos_sub_avx2(y, speed), _mm256_castsi256_ps(key_mask_avx2(input, active, INPUT_UP)));
+        y = _mm256_blendv_ps(y, pos_add_avx2(y, speed), _mm256_castsi256_ps(key_mask_avx2(input, active, INPUT_DOWN)));
+
+        _mm256_storeu_ps((float *)&state->x[i], x);
+        _mm256_storeu_ps((float *)&state->y[i], y);
+        state->active[i / 8] = (uint8_t)_mm256_movemask_ps(_mm256_castsi256_ps(active));
+    }
+}
+#endif
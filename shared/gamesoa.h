@@ -0,0 +1,51 @@
+#pragma once
+
+#include "gameimpl.h"
+#include <stdint.h>
+
+// Structure of arrays layout of GameState for simulating many players at once
+// Positions are kept in separate arrays, active flags as a bitmask (bit i % 8 of byte i / 8)
+// Events are packed into a byte per player, inputs into a byte with one bit per movement
+// All arrays are padded to SOA_LANES players so kernels can always load full vectors
+// The kernels only handle events and movement, collisions need to know where each world
+// starts so game_soa_collide() is run afterwards with the positions from before
+// Only the servers full events are supported, not the ENTER and EXIT events sent to clients
+
+#define SOA_LANES 8
+
+typedef struct
+{
+    int count;
+    game_pos_t *x;
+    game_pos_t *y;
+    uint8_t *active;
+} GameStateSoA;
+
+typedef struct
+{
+    int count;
+    uint8_t *events;
+    uint8_t *inputs;
+} GameEventsSoA;
+
+int game_soa_init(GameStateSoA *state, GameEventsSoA *events, int count);
+void game_soa_free(GameStateSoA *state, GameEventsSoA *events);
+
+void game_soa_load_state(GameStateSoA *state, int offset, const GameState *source);
+void game_soa_store_state(const GameStateSoA *state, int offset, GameState *out);
+void game_soa_load_events(GameEventsSoA *events, int offset, const GameEvents *source);
+void game_soa_load_state_strided(GameStateSoA *state, int offset, int stride, const GameState *source);
+void game_soa_store_state_strided(const GameStateSoA *state, int offset, int stride, GameState *out);
+void game_soa_load_events_strided(GameEventsSoA *events, int offset, int stride, const GameEvents *source);
+
+void game_soa_collide(GameStateSoA *state, const GameEventsSoA *events, const game_pos_t *from_x, const game_pos_t *from_y,
+                      int world_step, int stride, int capacity, int world_count);
+
+void game_simulate_soa(GameStateSoA *state, const GameEventsSoA *events);
+void game_simulate_soa_scalar(GameStateSoA *state, const GameEventsSoA *events);
+#ifdef __SSE2__
+void game_simulate_soa_sse2(GameStateSoA *state, const GameEventsSoA *events);
+#endif
+#ifdef __AVX2__
+void game_simulate_soa_avx2(GameStateSoA *state, const GameEventsSoA *events);
+#endif
@@ -1,6 +1,33 @@
 #define PORT 32000
 #define FRAME_BUFFER_SIZE 256
-#define MAX_CLIENTS 10
+#define DEFAULT_MAX_CLIENTS 10
+#define MAX_CLIENTS_LIMIT 4096
 #define SERVER_LISTEN_BACKLOG 5
-#define MAX_MESSAGE_SIZE 1024
-#define SIMULATION_TICK_RATE 30
\ No newline at end of file
+#define MAX_MESSAGE_SIZE 65536
+#define MESSAGE_QUEUE_SIZE 64
+#define SIMULATION_TICK_RATE 30
+#define SIMULATION_SPIN_NS 500000
+#define TIME_SYNC_SMOOTHING 0.1
+#define TIME_SYNC_STRETCH_PER_FRAME 0.02
+#define TIME_SYNC_MAX_STRETCH 0.1
+#define INPUT_DELAY_MODE INPUT_DELAY_ADAPTIVE
+#define INPUT_DELAY_FRAMES 2
+#define INPUT_DELAY_MAX 8
+#define INPUT_DELAY_RTT_SHARE 0.5
+#define INPUT_DELAY_HYSTERESIS 0.75
+#define INPUT_DELAY_ADJUST_FRAMES 30
+#define PING_INTERVAL_FRAMES 30
+#define RENDER_DEFAULT_FPS 60
+#define RECONCILE_FRAME_BUDGET 0
+#define STATE_HISTORY_MODE FRAME_RING_CHECKPOINTS
+#define STATE_CHECKPOINT_INTERVAL 1
+#define STATE_HASH_INTERVAL 8
+#define CLIENT_SPECULATION 0
+#define INTEREST_RADIUS 1200
+#define INTEREST_KEEP_RADIUS 1300
+#ifndef GAME_FIXED_POINT
+#define GAME_FIXED_POINT 1
+#endif
+#ifndef GAME_KERNELS
+#define GAME_KERNELS 0
+#endif
\ No newline at end of file
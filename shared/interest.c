@@ -0,0 +1,259 @@
+#include "interest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INTEREST_MARK_OLD 1
+#define INTEREST_MARK_NEW 2
+#define INTEREST_MARK_OLD_EDGE 4
+#define INTEREST_MARK_EDGE 8
+
+// Furthest a body can be from where a player starts its move and still block it, a diameter
+// from where it ends up after a step on each axis, rounded up
+#define INTEREST_EDGE_REACH (2 * PLAYER_RADIUS + 2 * PLAYER_SPEED)
+
+int interest_init(Interest *interest, int capacity)
+{
+    memset(interest, 0, sizeof(*interest));
+    interest->capacity = capacity;
+    interest->grid.cell_units = INTEREST_KEEP_RADIUS;
+    interest->bodies.cell_units = (int)(2 * INTEREST_EDGE_REACH / GAME_POS_ONE);
+    interest->players = calloc(capacity, sizeof(PlayerData));
+    interest->marks = calloc(capacity, sizeof(uint8_t));
+    interest->found = malloc(capacity * sizeof(int));
+    interest->touching = malloc(capacity * sizeof(int));
+    interest->entered = malloc(capacity * sizeof(uint16_t));
+    interest->next = malloc(capacity * sizeof(uint16_t));
+    interest->next_edges = malloc(capacity * sizeof(uint8_t));
+    interest->frame_slots = malloc(capacity * sizeof(uint16_t));
+    interest->frames = malloc(capacity * sizeof(PlayerFrame));
+    if (interest->players == NULL || interest->marks == NULL || interest->found == NULL || interest->touching == NULL || interest->entered == NULL ||
+        interest->next == NULL || interest->next_edges == NULL || interest->frame_slots == NULL || interest->frames == NULL)
+    {
+        perror("malloc()");
+        interest_free(interest);
+        return 1;
+    }
+    if (spatial_hash_reserve(&interest->grid, capacity) != 0) return 1;
+    return spatial_hash_reserve(&interest->bodies, capacity);
+}
+
+void interest_free(Interest *interest)
+{
+    spatial_hash_free(&interest->grid);
+    spatial_hash_free(&interest->bodies);
+    free(interest->players);
+    free(interest->marks);
+    free(interest->found);
+    free(interest->touching);
+    free(interest->entered);
+    free(interest->next);
+    free(interest->next_edges);
+    free(interest->frame_slots);
+    free(interest->frames);
+    memset(interest, 0, sizeof(*interest));
+}
+
+void interest_build(Interest *interest, const GameState *state, const GameEvents *events)
+{
+    // Where every player is once the events apply, which is where the frames movement starts
+    // Same rules as game_simulate_events() but leaves the state alone
+    // The second hash has collision sized cells for finding the edge players around each set
+    PlayerData *players = interest->players;
+    spatial_hash_begin(&interest->grid);
+    spatial_hash_begin(&interest->bodies);
+
+    const uint16_t *slots = game_state_active_slots(state);
+    for (int k = 0; k < state->active_count; ++k)
+    {
+        int i = slots[k];
+        players[i] = state->player_data[i];
+        if (events->players[i].event == PLAYER_EVENT_LEAVE)
+        {
+            players[i].active = false;
+            continue;
+        }
+        spatial_hash_add(&interest->grid, i, players[i].x, players[i].y);
+        spatial_hash_add(&interest->bodies, i, players[i].x, players[i].y);
+    }
+
+    for (int i = 0, found = 0; found < events->event_count; ++i)
+    {
+        if (events->players[i].event == PLAYER_EVENT_NONE) continue;
+        found++;
+        if (events->players[i].event != PLAYER_EVENT_JOIN) continue;
+
+        players[i].x = PLAYER_SPAWN_POS;
+        players[i].y = PLAYER_SPAWN_POS;
+        players[i].active = true;
+        spatial_hash_add(&interest->grid, i, players[i].x, players[i].y);
+        spatial_hash_add(&interest->bodies, i, players[i].x, players[i].y);
+    }
+
+    spatial_hash_end(&interest->grid);
+    spatial_hash_end(&interest->bodies);
+}
+
+static int interest_compare_slots(const void *a, const void *b)
+{
+    return (int)*(const uint16_t *)a - (int)*(const uint16_t *)b;
+}
+
+static void interest_add_frame(Interest *interest, int slot, PlayerFrame frame)
+{
+    interest->frame_slots[interest->frame_count] = (uint16_t)slot;
+    interest->frames[interest->frame_count] = frame;
+    interest->frame_count++;
+}
+
+static bool interest_touches_set(Interest *interest, int slot)
+{
+    // Whether any of the viewers new set could bump into the player this frame
+    const PlayerData *player = &interest->players[slot];
+    int count = spatial_hash_query(&interest->bodies, player->x, player->y, INTEREST_EDGE_REACH, interest->touching);
+    for (int k = 0; k < count; ++k)
+    {
+        if (interest->marks[interest->touching[k]] & INTEREST_MARK_NEW) return true;
+    }
+    return false;
+}
+
+int interest_update(Interest *interest, InterestSet *set, int viewer, const GameEvents *events)
+{
+    // Move the viewers set on to the frame built by interest_build() and fill in the frames
+    // it is sent, its players own frames with ENTER and EXIT for the ones coming and going
+    // and an ENTER placing each edge player
+    // Returns the frame count or -1 if the set could not grow, which leaves it unchanged
+    uint8_t *marks = interest->marks;
+    const PlayerData *players = interest->players;
+    for (int k = 0; k < set->count; ++k) marks[set->slots[k]] |= set->edges[k] ? INTEREST_MARK_OLD_EDGE : INTEREST_MARK_OLD;
+
+    // A viewer that has not joined yet or has left sees nobody
+    // Edge players can be up to the reach past anyone kept so the query covers them too
+    int found_count = 0;
+    if (players[viewer].active)
+    {
+        found_count = spatial_hash_query(&interest->grid, players[viewer].x, players[viewer].y, GAME_POS(INTEREST_KEEP_RADIUS) + INTEREST_EDGE_REACH,
+                                         interest->found);
+    }
+
+    const spatial_dist2_t enter_radius = (spatial_dist2_t)GAME_POS(INTEREST_RADIUS);
+    const spatial_dist2_t keep_radius = (spatial_dist2_t)GAME_POS(INTEREST_KEEP_RADIUS);
+    int entered_count = 0;
+    for (int k = 0; k < found_count; ++k)
+    {
+        int i = interest->found[k];
+        spatial_dist2_t dist2 = spatial_hash_dist2(players[viewer].x, players[viewer].y, players[i].x, players[i].y);
+        if (dist2 > ((marks[i] & INTEREST_MARK_OLD) ? keep_radius * keep_radius : enter_radius * enter_radius)) continue;
+
+        marks[i] |= INTEREST_MARK_NEW;
+        if (!(marks[i] & (INTEREST_MARK_OLD | INTEREST_MARK_OLD_EDGE))) interest->entered[entered_count++] = (uint16_t)i;
+    }
+
+    // Only once the whole set is known can the players around it be found
+    for (int k = 0; k < found_count; ++k)
+    {
+        int i = interest->found[k];
+        if ((marks[i] & INTEREST_MARK_NEW) || !interest_touches_set(interest, i)) continue;
+
+        marks[i] |= INTEREST_MARK_EDGE;
+        if (!(marks[i] & (INTEREST_MARK_OLD | INTEREST_MARK_OLD_EDGE))) interest->entered[entered_count++] = (uint16_t)i;
+    }
+    qsort(interest->entered, entered_count, sizeof(uint16_t), interest_compare_slots);
+
+    // Merge the kept and entered players back into slot order
+    interest->frame_count = 0;
+    int next_count = 0;
+    int old_k = 0, entered_k = 0;
+    while (old_k < set->count || entered_k < entered_count)
+    {
+        bool from_old = entered_k == entered_count || (old_k < set->count && set->slots[old_k] < interest->entered[entered_k]);
+        int i = from_old ? set->slots[old_k++] : interest->entered[entered_k++];
+        PlayerFrame frame = events->players[i];
+
+        if (!(marks[i] & (INTEREST_MARK_NEW | INTEREST_MARK_EDGE)))
+        {
+            // Still connected players just go out of view
+            memset(&frame, 0, sizeof(frame));
+            frame.event = events->players[i].event == PLAYER_EVENT_LEAVE ? PLAYER_EVENT_LEAVE : PLAYER_EVENT_EXIT;
+            interest_add_frame(interest, i, frame);
+            continue;
+        }
+
+        // Edge players are put where the server has them with nothing held, so never move
+        bool edge = !(marks[i] & INTEREST_MARK_NEW);
+        if (edge) memset(&frame, 0, sizeof(frame));
+        if (edge || (!(marks[i] & INTEREST_MARK_OLD) && frame.event != PLAYER_EVENT_JOIN))
+        {
+            frame.event = PLAYER_EVENT_ENTER;
+            frame.x = players[i].x;
+            frame.y = players[i].y;
+        }
+        interest->next[next_count] = (uint16_t)i;
+        interest->next_edges[next_count] = edge;
+        next_count++;
+        interest_add_frame(interest, i, frame);
+    }
+
+    for (int k = 0; k < set->count; ++k) marks[set->slots[k]] = 0;
+    for (int k = 0; k < found_count; ++k) marks[interest->found[k]] = 0;
+
+    if (next_count > set->size)
+    {
+        int size = set->size > 0 ? set->size : 16;
+        while (size < next_count) size *= 2;
+        uint16_t *slots = realloc(set->slots, size * sizeof(uint16_t));
+        if (slots != NULL) set->slots = slots;
+        uint8_t *edges = realloc(set->edges, size * sizeof(uint8_t));
+        if (edges != NULL) set->edges = edges;
+        if (slots == NULL || edges == NULL)
+        {
+            perror("realloc()");
+            interest->frame_count = 0;
+            return -1;
+        }
+        set->size = size;
+    }
+    memcpy(set->slots, interest->next, next_count * sizeof(uint16_t));
+    memcpy(set->edges, interest->next_edges, next_count * sizeof(uint8_t));
+    set->count = next_count;
+    return interest->frame_count;
+}
+
+uint32_t interest_set_hash(const Interest *interest, const InterestSet *set, const GameState *state, GameState *scratch)
+{
+    // game_state_hash_slots() of the set as the client has it after the frame, its players where
+    // the simulation moved them and edge players where they were placed
+    // Only the sets slots of the scratch state are written
+    for (int k = 0; k < set->count; ++k)
+    {
+        int i = set->slots[k];
+        scratch->player_data[i] = set->edges[k] ? interest->players[i] : state->player_data[i];
+    }
+    return game_state_hash_slots(scratch, set->slots, set->count);
+}
+
+void interest_set_free(InterestSet *set)
+{
+    free(set->slots);
+    free(set->edges);
+    memset(set, 0, sizeof(*set));
+}
+
+void interest_set_view(const InterestSet *set, const GameState *state, const GameEvents *events, GameState *out_state, GameEvents *out_events)
+{
+    // Only the players in the set, for sending a client a whole state it can carry on from
+    game_state_init(out_state, state->capacity);
+    game_events_clear(out_events);
+    for (int k = 0; k < set->count; ++k)
+    {
+        int i = set->slots[k];
+        out_state->player_data[i] = state->player_data[i];
+
+        // Edge players are placed again by their next frame
+        if (set->edges[k]) continue;
+        game_events_set(out_events, i, events->players[i].event);
+        out_events->players[i].input = events->players[i].input;
+    }
+    game_state_rebuild_active(out_state);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "gameimpl.h"
+#include "spatialhash.h"
+#include <stdint.h>
+
+// Area of interest filtering, which players the server sends each client
+//
+// Each frame the positions players have once that frames events apply go into a spatial hash
+// with cells INTEREST_KEEP_RADIUS wide. A client is sent the players within INTEREST_RADIUS of
+// its own and keeps being sent them until they are past INTEREST_KEEP_RADIUS, so players near
+// the edge do not flicker in and out. A player coming into a clients set is sent as an ENTER
+// event with its position and one going out as an EXIT, so a client only simulates its set.
+// Players close enough to the set to collide with it this frame but not in it are edge players,
+// sent every frame as an ENTER at where their movement starts with no input. The client places
+// them and never moves them, so the set moves exactly as on the server without simulating them.
+// Sets are in ascending slot order with edge players among them, interest_set_hash() is what a
+// client holding the set has once the frame is simulated
+
+typedef struct
+{
+    int count;
+    int size;
+    uint16_t *slots;
+    uint8_t *edges;
+} InterestSet;
+
+typedef struct
+{
+    int capacity;
+    SpatialHash grid;
+    SpatialHash bodies;
+    PlayerData *players;
+    uint8_t *marks;
+    int *found;
+    int *touching;
+    uint16_t *entered;
+    uint16_t *next;
+    uint8_t *next_edges;
+
+    // Frames for the set last updated, ascending by slot
+    int frame_count;
+    uint16_t *frame_slots;
+    PlayerFrame *frames;
+} Interest;
+
+int interest_init(Interest *interest, int capacity);
+void interest_free(Interest *interest);
+void interest_build(Interest *interest, const GameState *state, const GameEvents *events);
+int interest_update(Interest *interest, InterestSet *set, int viewer, const GameEvents *events);
+uint32_t interest_set_hash(const Interest *interest, const InterestSet *set, const GameState *state, GameState *scratch);
+
+void interest_set_free(InterestSet *set);
+void interest_set_view(const InterestSet *set, const GameState *state, const GameEvents *events, GameState *out_state, GameEvents *out_events);
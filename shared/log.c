@@ -4,8 +4,17 @@
 #include <stdio.h>
 #include <time.h>
 
+static bool log_enabled = true;
+
+void log_set_enabled(bool enabled)
+{
+    log_enabled = enabled;
+}
+
 void log_printf(const char *fmt, ...)
 {
+    if (!log_enabled) return;
+
     struct timespec ts;
     struct tm tm;
 
@@ -1,3 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
+
+void log_set_enabled(bool enabled);
 void log_printf(const char *fmt, ...);
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include "messagequeue.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int message_queue_init(MessageQueue *queue)
+{
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+
+    // Slots are MAX_MESSAGE_SIZE each so keep them off the stack
+    queue->messages = malloc(MESSAGE_QUEUE_SIZE * sizeof(QueuedMessage));
+    if (queue->messages == NULL)
+    {
+        perror("malloc()");
+        return 1;
+    }
+    return 0;
+}
+
+void message_queue_free(MessageQueue *queue)
+{
+    free(queue->messages);
+    queue->messages = NULL;
+}
+
+QueuedMessage *message_queue_begin_push(MessageQueue *queue)
+{
+    // PRODUCER ONLY: returns the next free slot or NULL if the queue is full
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head - tail >= MESSAGE_QUEUE_SIZE) return NULL;
+    return &queue->messages[head % MESSAGE_QUEUE_SIZE];
+}
+
+void message_queue_end_push(MessageQueue *queue)
+{
+    // PRODUCER ONLY: publish the slot given by message_queue_begin_push()
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+}
+
+const QueuedMessage *message_queue_front(MessageQueue *queue)
+{
+    // CONSUMER ONLY: returns the oldest published message or NULL if the queue is empty
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (head == tail) return NULL;
+    return &queue->messages[tail % MESSAGE_QUEUE_SIZE];
+}
+
+void message_queue_pop(MessageQueue *queue)
+{
+    // CONSUMER ONLY: hand the slot given by message_queue_front() back to the producer
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+}
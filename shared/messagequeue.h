@@ -0,0 +1,31 @@
+#pragma once
+
+#include "globals.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lock-free single producer single consumer queue of raw messages
+// The producer receives directly into the slot it is given so nothing is copied
+
+typedef struct
+{
+    size_t size;
+    uint8_t data[MAX_MESSAGE_SIZE];
+} QueuedMessage;
+
+typedef struct
+{
+    atomic_uint head;
+    atomic_uint tail;
+    QueuedMessage *messages;
+} MessageQueue;
+
+int message_queue_init(MessageQueue *queue);
+void message_queue_free(MessageQueue *queue);
+
+QueuedMessage *message_queue_begin_push(MessageQueue *queue);
+void message_queue_end_push(MessageQueue *queue);
+
+const QueuedMessage *message_queue_front(MessageQueue *queue);
+void message_queue_pop(MessageQueue *queue);
@@ -0,0 +1,102 @@
+#include "pacer.h"
+#include "log.h"
+#include <errno.h>
+#include <time.h>
+
+#define PACER_NS_PER_SECOND 1000000000LL
+
+int64_t pacer_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * PACER_NS_PER_SECOND + ts.tv_nsec;
+}
+
+void pacer_init(Pacer *pacer, int rate, int64_t spin_ns)
+{
+    // The first deadline is a tick from now
+    pacer->rate = rate;
+    pacer->spin_ns = spin_ns;
+    pacer->start_ns = pacer_now_ns();
+    pacer->tick = 0;
+    pacer->span_ns = PACER_NS_PER_SECOND;
+    pacer->ticks = 0;
+    pacer->skipped = 0;
+    pacer->late = 0;
+    pacer->jitter_max_ns = 0;
+    pacer->jitter_sum_ns = 0.0;
+}
+
+static int64_t pacer_tick_ns(const Pacer *pacer, int64_t tick)
+{
+    return pacer->start_ns + tick * pacer->span_ns / pacer->rate;
+}
+
+int64_t pacer_deadline_ns(const Pacer *pacer)
+{
+    // When the next pacer_wait() returns
+    return pacer_tick_ns(pacer, pacer->tick + 1);
+}
+
+void pacer_wait(Pacer *pacer)
+{
+    // Wait for the next tick, straight away if it is already due
+    int64_t now = pacer_now_ns();
+    int64_t deadline = pacer_deadline_ns(pacer);
+    if (now - deadline >= pacer->span_ns / pacer->rate)
+    {
+        // More than a whole tick behind, the last deadline that has passed becomes the next one
+        int64_t due = (now - pacer->start_ns) * pacer->rate / pacer->span_ns;
+        pacer->skipped += due - pacer->tick - 1;
+        pacer->tick = due - 1;
+        deadline = pacer_deadline_ns(pacer);
+    }
+    pacer->tick++;
+
+    int64_t sleep_until = deadline - pacer->spin_ns;
+    if (now < sleep_until)
+    {
+        struct timespec ts = {sleep_until / PACER_NS_PER_SECOND, sleep_until % PACER_NS_PER_SECOND};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        {
+        }
+    }
+    while ((now = pacer_now_ns()) < deadline)
+    {
+    }
+
+    int64_t jitter = now - deadline;
+    pacer->ticks++;
+    pacer->jitter_sum_ns += (double)jitter;
+    if (jitter > PACER_LATE_NS) pacer->late++;
+    if (jitter > pacer->jitter_max_ns) pacer->jitter_max_ns = jitter;
+}
+
+void pacer_set_stretch(Pacer *pacer, double stretch)
+{
+    // Period scaled by 1 + stretch, deadlines carry on from the last one so nothing jumps
+    int64_t span_ns = (int64_t)((double)PACER_NS_PER_SECOND * (1.0 + stretch));
+    if (span_ns == pacer->span_ns) return;
+    pacer->start_ns = pacer_tick_ns(pacer, pacer->tick);
+    pacer->tick = 0;
+    pacer->span_ns = span_ns;
+}
+
+void pacer_stats(const Pacer *pacer, PacerStats *out_stats)
+{
+    // Jitter is how long after its deadline each wait returned
+    out_stats->ticks = pacer->ticks;
+    out_stats->skipped = pacer->skipped;
+    out_stats->late = pacer->late;
+    out_stats->jitter_mean_us = pacer->ticks > 0 ? pacer->jitter_sum_ns / (double)pacer->ticks / 1000.0 : 0.0;
+    out_stats->jitter_max_us = (double)pacer->jitter_max_ns / 1000.0;
+}
+
+void pacer_log_stats(const Pacer *pacer, const char *name)
+{
+    PacerStats stats;
+    pacer_stats(pacer, &stats);
+    if (stats.ticks == 0) return;
+    log_printf("%s: %lld ticks at %d Hz, %lld late, %lld skipped, jitter %.1f us mean, %.1f us max\n", name, (long long)stats.ticks, pacer->rate,
+               (long long)stats.late, (long long)stats.skipped, stats.jitter_mean_us, stats.jitter_max_us);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+// Fixed rate tick clock for loops that have to run on time
+//
+// Deadlines are start + n / rate computed exactly in nanoseconds so they never drift, however
+// long each tick takes or the period rounds. Waiting sleeps with an absolute clock_nanosleep()
+// to spin_ns before the deadline and spins the rest of the way, as sleeps can overshoot by
+// most of a scheduler tick. A loop that falls more than a tick behind skips the ticks it
+// missed rather than running them back to back.
+// How late each wake was is kept for pacer_stats(), ticks over PACER_LATE_NS count as late
+// pacer_set_stretch() lengthens or shortens the period from the next deadline on, for loops
+// that have to keep time with another clock rather than just their own
+
+#define PACER_LATE_NS 1000000
+
+typedef struct
+{
+    int64_t ticks;
+    int64_t skipped;
+    int64_t late;
+    double jitter_mean_us;
+    double jitter_max_us;
+} PacerStats;
+
+typedef struct
+{
+    int rate;
+    int64_t spin_ns;
+    int64_t start_ns;
+    int64_t tick;
+    // How long rate ticks take, a second unless stretched
+    int64_t span_ns;
+
+    int64_t ticks;
+    int64_t skipped;
+    int64_t late;
+    int64_t jitter_max_ns;
+    double jitter_sum_ns;
+} Pacer;
+
+int64_t pacer_now_ns(void);
+
+void pacer_init(Pacer *pacer, int rate, int64_t spin_ns);
+int64_t pacer_deadline_ns(const Pacer *pacer);
+void pacer_wait(Pacer *pacer);
+void pacer_set_stretch(Pacer *pacer, double stretch);
+
+void pacer_stats(const Pacer *pacer, PacerStats *out_stats);
+void pacer_log_stats(const Pacer *pacer, const char *name);
@@ -1,8 +1,202 @@
 #include "protocol.h"
 #include <arpa/inet.h>
 #include <assert.h>
+#include <endian.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/socket.h>
+
+// Framing
+
+ssize_t recv_message(int socket_fd, uint8_t *buffer, size_t buffer_size)
+{
+    // Receive exactly one message, the header and then the payload it describes
+    // TCP gives no message boundaries so a single recv() may hold several or part of one
+    ssize_t received = recv(socket_fd, buffer, sizeof(MessageHeader), MSG_WAITALL);
+    if (received <= 0) return received;
+    if (received != sizeof(MessageHeader)) return -1;
+
+    MessageHeader header;
+    memcpy(&header, buffer, sizeof(header));
+
+    size_t payload_size = ntohs(header.payload_size);
+    if (sizeof(header) + payload_size > buffer_size) return -1;
+    if (payload_size == 0) return sizeof(header);
+
+    received = recv(socket_fd, buffer + sizeof(header), payload_size, MSG_WAITALL);
+    if (received <= 0) return received;
+    if ((size_t)received != payload_size) return -1;
+
+    return sizeof(header) + payload_size;
+}
+
+ssize_t send_message(int socket_fd, const uint8_t *buffer, size_t message_size)
+{
+    // Send all of one message, a send() interrupted part way would otherwise leave it cut short
+    // Threads sharing a socket still have to hold a lock around this to keep messages whole
+    size_t sent = 0;
+    while (sent < message_size)
+    {
+        ssize_t result = send(socket_fd, buffer + sent, message_size - sent, 0);
+        if (result < 0) return result;
+        sent += result;
+    }
+    return sent;
+}
+
+// Payload encoding
+
+static uint8_t pack_input(const PlayerInput *input)
+{
+    uint8_t bits = 0;
+    for (int i = 0; i < 4; ++i) bits |= (uint8_t)(input->movements_held[i] << i);
+    return bits;
+}
+
+static void unpack_input(uint8_t bits, PlayerInput *out_input)
+{
+    for (int i = 0; i < 4; ++i) out_input->movements_held[i] = (bits >> i) & 1;
+}
+
+static size_t write_state(uint8_t *buffer, const GameState *state)
+{
+    size_t offset = 0;
+    uint16_t active_count = htons(state->active_count);
+    memcpy(buffer + offset, &active_count, sizeof(active_count));
+    offset += sizeof(active_count);
+
+    const uint16_t *slots = game_state_active_slots(state);
+    for (int k = 0; k < state->active_count; ++k)
+    {
+        const PlayerData *player_data = &state->player_data[slots[k]];
+        uint16_t slot = htons(slots[k]);
+        memcpy(buffer + offset, &slot, sizeof(slot));
+        offset += sizeof(slot);
+        memcpy(buffer + offset, &player_data->x, sizeof(game_pos_t));
+        offset += sizeof(game_pos_t);
+        memcpy(buffer + offset, &player_data->y, sizeof(game_pos_t));
+        offset += sizeof(game_pos_t);
+    }
+    return offset;
+}
+
+static size_t read_state(const uint8_t *buffer, GameState *out_state)
+{
+    game_state_init(out_state, out_state->capacity);
+
+    size_t offset = 0;
+    uint16_t active_count;
+    memcpy(&active_count, buffer + offset, sizeof(active_count));
+    offset += sizeof(active_count);
+    active_count = ntohs(active_count);
+    assert(active_count <= out_state->capacity);
+
+    uint16_t *slots = game_state_active_slots(out_state);
+    for (int k = 0; k < active_count; ++k)
+    {
+        uint16_t slot;
+        memcpy(&slot, buffer + offset, sizeof(slot));
+        offset += sizeof(slot);
+        slot = ntohs(slot);
+        assert(slot < out_state->capacity && (k == 0 || slot > slots[k - 1]));
+
+        PlayerData *player_data = &out_state->player_data[slot];
+        memcpy(&player_data->x, buffer + offset, sizeof(game_pos_t));
+        offset += sizeof(game_pos_t);
+        memcpy(&player_data->y, buffer + offset, sizeof(game_pos_t));
+        offset += sizeof(game_pos_t);
+        player_data->active = true;
+        slots[k] = slot;
+    }
+    out_state->active_count = active_count;
+    return offset;
+}
+
+static size_t write_player_frame(uint8_t *buffer, int index, const PlayerFrame *player_frame, uint16_t *frame_count)
+{
+    // Nothing is written for empty frames
+    uint8_t input = pack_input(&player_frame->input);
+    if (player_frame->event == PLAYER_EVENT_NONE && input == 0) return 0;
+
+    size_t offset = 0;
+    uint16_t slot = htons(index);
+    memcpy(buffer + offset, &slot, sizeof(slot));
+    offset += sizeof(slot);
+    buffer[offset++] = (uint8_t)player_frame->event;
+    buffer[offset++] = input;
+    if (player_frame->event == PLAYER_EVENT_ENTER)
+    {
+        memcpy(buffer + offset, &player_frame->x, sizeof(game_pos_t));
+        offset += sizeof(game_pos_t);
+        memcpy(buffer + offset, &player_frame->y, sizeof(game_pos_t));
+        offset += sizeof(game_pos_t);
+    }
+    (*frame_count)++;
+    return offset;
+}
+
+static size_t write_events(uint8_t *buffer, const GameEvents *events)
+{
+    // Count is written last once the non-empty frames are known
+    size_t offset = sizeof(uint16_t);
+    uint16_t frame_count = 0;
+    for (int i = 0; i < events->capacity; ++i)
+    {
+        offset += write_player_frame(buffer + offset, i, &events->players[i], &frame_count);
+    }
+
+    frame_count = htons(frame_count);
+    memcpy(buffer, &frame_count, sizeof(frame_count));
+    return offset;
+}
+
+static size_t write_player_frames(uint8_t *buffer, const uint16_t *slots, const PlayerFrame *frames, int count)
+{
+    // Same encoding as write_events() from a sparse list of frames
+    size_t offset = sizeof(uint16_t);
+    uint16_t frame_count = 0;
+    for (int k = 0; k < count; ++k)
+    {
+        offset += write_player_frame(buffer + offset, slots[k], &frames[k], &frame_count);
+    }
+
+    frame_count = htons(frame_count);
+    memcpy(buffer, &frame_count, sizeof(frame_count));
+    return offset;
+}
+
+static size_t read_events(const uint8_t *buffer, GameEvents *out_events)
+{
+    game_events_clear(out_events);
+
+    size_t offset = 0;
+    uint16_t frame_count;
+    memcpy(&frame_count, buffer + offset, sizeof(frame_count));
+    offset += sizeof(frame_count);
+    frame_count = ntohs(frame_count);
+    assert(frame_count <= out_events->capacity);
+
+    for (int k = 0; k < frame_count; ++k)
+    {
+        uint16_t slot;
+        memcpy(&slot, buffer + offset, sizeof(slot));
+        offset += sizeof(slot);
+        slot = ntohs(slot);
+        assert(slot < out_events->capacity);
+
+        PlayerFrame *player_frame = &out_events->players[slot];
+        game_events_set(out_events, slot, (PlayerEvent)buffer[offset++]);
+        unpack_input(buffer[offset++], &player_frame->input);
+        if (player_frame->event == PLAYER_EVENT_ENTER)
+        {
+            memcpy(&player_frame->x, buffer + offset, sizeof(game_pos_t));
+            offset += sizeof(game_pos_t);
+            memcpy(&player_frame->y, buffer + offset, sizeof(game_pos_t));
+            offset += sizeof(game_pos_t);
+        }
+    }
+    return offset;
+}
 
 // MSG_P2S_FRAME_INPUTS
 
@@ -53,27 +247,118 @@ void deserialize_p2s_frame_inputs(const uint8_t *buffer, size_t message_size, in
 
 // MSG_S2P_FRAME_GAME_EVENTS
 
-size_t serialize_s2p_frame_game_events(uint8_t *buffer, int frame, const GameEvents *events)
+static size_t write_s2p_frame_tail(uint8_t *buffer, size_t offset, int frame, bool has_hash, uint32_t state_hash, int frame_advantage)
 {
+    // Finish off a MSG_S2P_FRAME_GAME_EVENTS whose events end at offset
+    buffer[offset++] = has_hash;
+    if (has_hash)
+    {
+        uint32_t hash = htonl(state_hash);
+        memcpy(buffer + offset, &hash, sizeof(hash));
+        offset += sizeof(hash);
+    }
+
+    if (frame_advantage > INT16_MAX) frame_advantage = INT16_MAX;
+    if (frame_advantage < INT16_MIN) frame_advantage = INT16_MIN;
+    uint16_t advantage = htons((uint16_t)(int16_t)frame_advantage);
+    memcpy(buffer + offset, &advantage, sizeof(advantage));
+    offset += sizeof(advantage);
+
     MessageHeader header;
     header.type = MSG_S2P_FRAME_GAME_EVENTS;
     header.frame = htonl(frame);
-    header.payload_size = htons(sizeof(S2PGameEventsPayload));
+    header.payload_size = htons(offset - sizeof(header));
+    memcpy(buffer, &header, sizeof(header));
+
+    return offset;
+}
 
-    S2PGameEventsPayload payload;
-    payload.events = *events;
+size_t serialize_s2p_frame_game_events(uint8_t *buffer, int frame, const GameEvents *events, bool has_hash, uint32_t state_hash, int frame_advantage)
+{
+    size_t offset = sizeof(MessageHeader);
+    offset += write_events(buffer + offset, events);
+    return write_s2p_frame_tail(buffer, offset, frame, has_hash, state_hash, frame_advantage);
+}
+
+size_t serialize_s2p_frame_player_frames(uint8_t *buffer, int frame, const uint16_t *slots, const PlayerFrame *frames, int count, bool has_hash, uint32_t state_hash,
+                                         int frame_advantage)
+{
+    size_t offset = sizeof(MessageHeader);
+    offset += write_player_frames(buffer + offset, slots, frames, count);
+    return write_s2p_frame_tail(buffer, offset, frame, has_hash, state_hash, frame_advantage);
+}
 
+void deserialize_s2p_frame_game_events(const uint8_t *buffer, size_t message_size, int *out_frame, GameEvents *out_events, bool *out_has_hash, uint32_t *out_state_hash,
+                                       int *out_frame_advantage)
+{
     size_t offset = 0;
-    memcpy(buffer + offset, &header, sizeof(header));
+
+    assert(message_size >= sizeof(MessageHeader));
+
+    MessageHeader header;
+    memcpy(&header, buffer + offset, sizeof(header));
     offset += sizeof(header);
 
+    assert(header.type == MSG_S2P_FRAME_GAME_EVENTS);
+
+    uint16_t payload_size = ntohs(header.payload_size);
+    assert(message_size >= sizeof(MessageHeader) + payload_size);
+
+    offset += read_events(buffer + offset, out_events);
+
+    *out_has_hash = buffer[offset++];
+    if (*out_has_hash)
+    {
+        uint32_t hash;
+        memcpy(&hash, buffer + offset, sizeof(hash));
+        offset += sizeof(hash);
+        *out_state_hash = ntohl(hash);
+    }
+
+    uint16_t advantage;
+    memcpy(&advantage, buffer + offset, sizeof(advantage));
+    offset += sizeof(advantage);
+    *out_frame_advantage = (int16_t)ntohs(advantage);
+    assert(offset == sizeof(MessageHeader) + payload_size);
+
+    *out_frame = ntohl(header.frame);
+}
+
+// MSG_S2P_INIT_PLAYER
+
+size_t serialize_init_player(uint8_t *buffer, int frame, const GameState *state, const GameEvents *events, int client_index)
+{
+    InitPlayerPayload payload;
+    payload.capacity = htonl(state->capacity);
+    payload.client_index = htonl(client_index);
+
+    size_t offset = sizeof(MessageHeader);
     memcpy(buffer + offset, &payload, sizeof(payload));
     offset += sizeof(payload);
 
+    offset += write_state(buffer + offset, state);
+    offset += write_events(buffer + offset, events);
+
+    MessageHeader header;
+    header.type = MSG_S2P_INIT_PLAYER;
+    header.frame = htonl(frame);
+    header.payload_size = htons(offset - sizeof(header));
+    memcpy(buffer, &header, sizeof(header));
+
     return offset;
 }
 
-void deserialize_s2p_frame_game_events(const uint8_t *buffer, size_t message_size, int *out_frame, GameEvents *out_events)
+int deserialize_init_player_capacity(const uint8_t *buffer, size_t message_size)
+{
+    // The capacity is needed to allocate the state and events before deserializing
+    assert(message_size >= sizeof(MessageHeader) + sizeof(InitPlayerPayload));
+
+    InitPlayerPayload payload;
+    memcpy(&payload, buffer + sizeof(MessageHeader), sizeof(payload));
+    return ntohl(payload.capacity);
+}
+
+void deserialize_init_player(const uint8_t *buffer, size_t message_size, int *out_frame, GameState *out_state, GameEvents *out_events, int *out_client_index)
 {
     size_t offset = 0;
 
@@ -83,31 +368,37 @@ void deserialize_s2p_frame_game_events(const uint8_t *buffer, size_t message_siz
     memcpy(&header, buffer + offset, sizeof(header));
     offset += sizeof(header);
 
-    assert(header.type == MSG_S2P_FRAME_GAME_EVENTS);
+    assert(header.type == MSG_S2P_INIT_PLAYER);
 
     uint16_t payload_size = ntohs(header.payload_size);
-    assert(payload_size == sizeof(S2PGameEventsPayload));
+    assert(payload_size >= sizeof(InitPlayerPayload));
     assert(message_size >= sizeof(MessageHeader) + payload_size);
 
-    S2PGameEventsPayload payload;
+    InitPlayerPayload payload;
     memcpy(&payload, buffer + offset, sizeof(payload));
+    offset += sizeof(payload);
+
+    assert((int)ntohl(payload.capacity) == out_state->capacity);
+    assert(out_events->capacity == out_state->capacity);
+
+    offset += read_state(buffer + offset, out_state);
+    offset += read_events(buffer + offset, out_events);
+    assert(offset == sizeof(MessageHeader) + payload_size);
 
     *out_frame = ntohl(header.frame);
-    *out_events = payload.events;
+    *out_client_index = ntohl(payload.client_index);
 }
 
-// MSG_S2P_INIT_PLAYER
+// MSG_P2S_RESYNC_REQUEST
 
-size_t serialize_init_player(uint8_t *buffer, int frame, const GameState *state, const GameEvents *events, int client_index)
+size_t serialize_p2s_resync_request(uint8_t *buffer, int frame, int client_index)
 {
     MessageHeader header;
-    header.type = MSG_S2P_INIT_PLAYER;
+    header.type = MSG_P2S_RESYNC_REQUEST;
     header.frame = htonl(frame);
-    header.payload_size = htons(sizeof(InitPlayerPayload));
+    header.payload_size = htons(sizeof(P2SResyncRequestPayload));
 
-    InitPlayerPayload payload;
-    payload.state = *state;
-    payload.events = *events;
+    P2SResyncRequestPayload payload;
     payload.client_index = htonl(client_index);
 
     size_t offset = 0;
@@ -120,7 +411,7 @@ size_t serialize_init_player(uint8_t *buffer, int frame, const GameState *state,
     return offset;
 }
 
-void deserialize_init_player(const uint8_t *buffer, size_t message_size, int *out_frame, GameState *out_state, GameEvents *out_events, int *out_client_index)
+void deserialize_p2s_resync_request(const uint8_t *buffer, size_t message_size, int *out_frame, int *out_client_index)
 {
     size_t offset = 0;
 
@@ -130,17 +421,91 @@ void deserialize_init_player(const uint8_t *buffer, size_t message_size, int *ou
     memcpy(&header, buffer + offset, sizeof(header));
     offset += sizeof(header);
 
-    assert(header.type == MSG_S2P_INIT_PLAYER);
+    assert(header.type == MSG_P2S_RESYNC_REQUEST);
 
     uint16_t payload_size = ntohs(header.payload_size);
-    assert(payload_size == sizeof(InitPlayerPayload));
+    assert(payload_size == sizeof(P2SResyncRequestPayload));
     assert(message_size >= sizeof(MessageHeader) + payload_size);
 
-    InitPlayerPayload payload;
+    P2SResyncRequestPayload payload;
     memcpy(&payload, buffer + offset, sizeof(payload));
 
     *out_frame = ntohl(header.frame);
-    *out_state = payload.state;
-    *out_events = payload.events;
     *out_client_index = ntohl(payload.client_index);
 }
+
+// MSG_S2P_STATE_RESYNC
+
+size_t serialize_s2p_state_resync(uint8_t *buffer, int frame, const GameState *state, const GameEvents *events)
+{
+    size_t offset = sizeof(MessageHeader);
+    offset += write_state(buffer + offset, state);
+    offset += write_events(buffer + offset, events);
+
+    MessageHeader header;
+    header.type = MSG_S2P_STATE_RESYNC;
+    header.frame = htonl(frame);
+    header.payload_size = htons(offset - sizeof(header));
+    memcpy(buffer, &header, sizeof(header));
+
+    return offset;
+}
+
+void deserialize_s2p_state_resync(const uint8_t *buffer, size_t message_size, int *out_frame, GameState *out_state, GameEvents *out_events)
+{
+    size_t offset = 0;
+
+    assert(message_size >= sizeof(MessageHeader));
+
+    MessageHeader header;
+    memcpy(&header, buffer + offset, sizeof(header));
+    offset += sizeof(header);
+
+    assert(header.type == MSG_S2P_STATE_RESYNC);
+
+    uint16_t payload_size = ntohs(header.payload_size);
+    assert(message_size >= sizeof(MessageHeader) + payload_size);
+
+    offset += read_state(buffer + offset, out_state);
+    offset += read_events(buffer + offset, out_events);
+    assert(offset == sizeof(MessageHeader) + payload_size);
+
+    *out_frame = ntohl(header.frame);
+}
+
+// MSG_PING and MSG_PONG
+
+size_t serialize_ping(uint8_t *buffer, MessageType type, int frame, int64_t origin_ns, int64_t reply_ns)
+{
+    MessageHeader header;
+    header.type = type;
+    header.frame = htonl(frame);
+    header.payload_size = htons(sizeof(PingPayload));
+
+    PingPayload payload;
+    payload.origin_ns = (int64_t)htobe64((uint64_t)origin_ns);
+    payload.reply_ns = (int64_t)htobe64((uint64_t)reply_ns);
+
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), &payload, sizeof(payload));
+    return sizeof(header) + sizeof(payload);
+}
+
+void deserialize_ping(const uint8_t *buffer, size_t message_size, int *out_frame, int64_t *out_origin_ns, int64_t *out_reply_ns)
+{
+    assert(message_size >= sizeof(MessageHeader));
+
+    MessageHeader header;
+    memcpy(&header, buffer, sizeof(header));
+
+    assert(header.type == MSG_PING || header.type == MSG_PONG);
+    assert(ntohs(header.payload_size) == sizeof(PingPayload));
+    assert(message_size >= sizeof(MessageHeader) + sizeof(PingPayload));
+
+    PingPayload payload;
+    memcpy(&payload, buffer + sizeof(header), sizeof(payload));
+
+    *out_frame = ntohl(header.frame);
+    *out_origin_ns = (int64_t)be64toh((uint64_t)payload.origin_ns);
+    *out_reply_ns = (int64_t)be64toh((uint64_t)payload.reply_ns);
+}
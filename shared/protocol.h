@@ -1,10 +1,15 @@
 #include "gameimpl.h"
+#include <sys/types.h>
 
 typedef enum
 {
     MSG_P2S_FRAME_INPUTS = 1,
     MSG_S2P_FRAME_GAME_EVENTS,
     MSG_S2P_INIT_PLAYER,
+    MSG_P2S_RESYNC_REQUEST,
+    MSG_S2P_STATE_RESYNC,
+    MSG_PING,
+    MSG_PONG,
 } MessageType;
 
 typedef struct
@@ -14,14 +19,29 @@ typedef struct
     uint16_t payload_size;
 } __attribute__((packed)) MessageHeader;
 
+ssize_t recv_message(int socket_fd, uint8_t *buffer, size_t buffer_size);
+ssize_t send_message(int socket_fd, const uint8_t *buffer, size_t message_size);
+
+// Variable length payloads, only active players and non-empty player frames are sent
+// so their size follows the player count rather than the capacity:
+//   state:  u16 active_count, then (u16 slot, x, y as game_pos_t) per active player
+//   events: u16 frame_count, then (u16 slot, u8 event, u8 input bits) per non-empty frame
+//           followed by x, y as game_pos_t for PLAYER_EVENT_ENTER
+// MSG_S2P_FRAME_GAME_EVENTS follows the events with u8 has_hash and then a u32 state hash
+// if set, the game_state_hash() of the state after the frame is simulated, and ends with the
+// receiving clients frame advantage as an i16 in 1/FRAME_ADVANTAGE_SCALE frames
+
+// How far ahead of the rest of the room a clients inputs reach the server, negative if behind
+#define FRAME_ADVANTAGE_SCALE 64
+
 typedef struct
 {
-    GameState state;
-    GameEvents events;
+    int capacity;
     int client_index;
 } __attribute__((packed)) InitPlayerPayload;
 
 size_t serialize_init_player(uint8_t *buffer, int frame, const GameState *state, const GameEvents *events, int client_index);
+int deserialize_init_player_capacity(const uint8_t *buffer, size_t message_size);
 void deserialize_init_player(const uint8_t *buffer, size_t message_size, int *out_frame, GameState *out_state, GameEvents *out_events, int *out_client_index);
 
 typedef struct
@@ -33,10 +53,34 @@ typedef struct
 size_t serialize_p2s_frame_inputs(uint8_t *buffer, int frame, int client_index, const PlayerInput *input);
 void deserialize_p2s_frame_inputs(const uint8_t *buffer, size_t message_size, int *out_frame, int *out_client_index, PlayerInput *out_input);
 
+size_t serialize_s2p_frame_game_events(uint8_t *buffer, int frame, const GameEvents *events, bool has_hash, uint32_t state_hash, int frame_advantage);
+// The same message from a sparse list of frames, for clients only sent some players
+size_t serialize_s2p_frame_player_frames(uint8_t *buffer, int frame, const uint16_t *slots, const PlayerFrame *frames, int count, bool has_hash, uint32_t state_hash,
+                                         int frame_advantage);
+void deserialize_s2p_frame_game_events(const uint8_t *buffer, size_t message_size, int *out_frame, GameEvents *out_events, bool *out_has_hash, uint32_t *out_state_hash,
+                                       int *out_frame_advantage);
+
+typedef struct
+{
+    int client_index;
+} __attribute__((packed)) P2SResyncRequestPayload;
+
+size_t serialize_p2s_resync_request(uint8_t *buffer, int frame, int client_index);
+void deserialize_p2s_resync_request(const uint8_t *buffer, size_t message_size, int *out_frame, int *out_client_index);
+
+// The confirmed state at the frame followed by its events so far, same as MSG_S2P_INIT_PLAYER
+// the events are not final yet and the frame is still sent as MSG_S2P_FRAME_GAME_EVENTS
+size_t serialize_s2p_state_resync(uint8_t *buffer, int frame, const GameState *state, const GameEvents *events);
+void deserialize_s2p_state_resync(const uint8_t *buffer, size_t message_size, int *out_frame, GameState *out_state, GameEvents *out_events);
+
+// Sent either way at any time and answered straight away by a MSG_PONG echoing origin_ns
+// with reply_ns set, both nanoseconds on the senders own monotonic clock. The frame is the
+// senders current one, for logs only
 typedef struct
 {
-    GameEvents events;
-} __attribute__((packed)) S2PGameEventsPayload;
+    int64_t origin_ns;
+    int64_t reply_ns;
+} __attribute__((packed)) PingPayload;
 
-size_t serialize_s2p_frame_game_events(uint8_t *buffer, int frame, const GameEvents *events);
-void deserialize_s2p_frame_game_events(const uint8_t *buffer, size_t message_size, int *out_frame, GameEvents *out_events);
+size_t serialize_ping(uint8_t *buffer, MessageType type, int frame, int64_t origin_ns, int64_t reply_ns);
+void deserialize_ping(const uint8_t *buffer, size_t message_size, int *out_frame, int64_t *out_origin_ns, int64_t *out_reply_ns);
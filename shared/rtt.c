@@ -0,0 +1,65 @@
+#include "rtt.h"
+#include "log.h"
+
+#define RTT_SMOOTHING 0.125
+#define RTT_JITTER_SMOOTHING 0.25
+
+void rtt_estimator_init(RttEstimator *rtt)
+{
+    rtt->samples = 0;
+    rtt->srtt = 0.0;
+    rtt->rttvar = 0.0;
+    rtt->min_rtt = 0.0;
+    rtt->last_rtt = 0.0;
+    rtt->clock_offset = 0.0;
+    rtt->offset_samples = 0;
+}
+
+void rtt_estimator_add(RttEstimator *rtt, double sample)
+{
+    if (sample < 0.0) sample = 0.0;
+    rtt->last_rtt = sample;
+    if (rtt->samples++ == 0)
+    {
+        rtt->srtt = sample;
+        rtt->rttvar = sample / 2.0;
+        rtt->min_rtt = sample;
+        return;
+    }
+
+    double deviation = sample > rtt->srtt ? sample - rtt->srtt : rtt->srtt - sample;
+    rtt->rttvar += (deviation - rtt->rttvar) * RTT_JITTER_SMOOTHING;
+    rtt->srtt += (sample - rtt->srtt) * RTT_SMOOTHING;
+    if (sample < rtt->min_rtt) rtt->min_rtt = sample;
+}
+
+void rtt_estimator_add_ping(RttEstimator *rtt, int64_t sent_ns, int64_t peer_ns, int64_t received_ns)
+{
+    // sent_ns and received_ns on the local monotonic clock, peer_ns on the peers when it replied
+    double sample = (double)(received_ns - sent_ns) * 1e-9;
+    double offset = (double)((peer_ns - sent_ns) - (received_ns - sent_ns) / 2) * 1e-9;
+    rtt_estimator_add(rtt, sample);
+    if (rtt->offset_samples > 0 && sample > rtt->srtt) return;
+    if (rtt->offset_samples++ == 0) rtt->clock_offset = offset;
+    else rtt->clock_offset += (offset - rtt->clock_offset) * RTT_SMOOTHING;
+}
+
+void rtt_estimator_stats(const RttEstimator *rtt, RttStats *out_stats)
+{
+    out_stats->samples = rtt->samples;
+    out_stats->rtt_ms = rtt->srtt * 1000.0;
+    out_stats->jitter_ms = rtt->rttvar * 1000.0;
+    out_stats->min_rtt_ms = rtt->min_rtt * 1000.0;
+    out_stats->last_rtt_ms = rtt->last_rtt * 1000.0;
+    out_stats->one_way_ms = rtt->srtt * 500.0;
+    out_stats->clock_offset_ms = rtt->clock_offset * 1000.0;
+}
+
+void rtt_estimator_log_stats(const RttEstimator *rtt, const char *name)
+{
+    RttStats stats;
+    rtt_estimator_stats(rtt, &stats);
+    if (stats.samples == 0) return;
+    log_printf("%s: round trip %.2f ms (jitter %.2f ms, min %.2f ms) over %d samples, one way %.2f ms, peer clock %+.2f ms\n", name, stats.rtt_ms,
+               stats.jitter_ms, stats.min_rtt_ms, stats.samples, stats.one_way_ms, stats.clock_offset_ms);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+// Smoothed round trip time and its jitter from a stream of samples, in seconds
+//
+// The usual TCP estimator: the mean deviation is updated against the old smoothed value
+// before that moves an eighth of the way to the sample, and the first sample sets both.
+// The smallest sample seen is kept too, the round trip with nothing queued along the way.
+// rtt_estimator_add_ping() takes a ping timed at both ends, which also gives how far the
+// peers clock is ahead, taken from the round trips no slower than usual as queueing on the
+// way there or back skews it. One way delay can only be had as half the round trip, the two
+// are indistinguishable from a clock offset
+
+typedef struct
+{
+    int samples;
+    double rtt_ms;
+    double jitter_ms;
+    double min_rtt_ms;
+    double last_rtt_ms;
+    double one_way_ms;
+    double clock_offset_ms;
+} RttStats;
+
+typedef struct
+{
+    int samples;
+    double srtt;
+    double rttvar;
+    double min_rtt;
+    double last_rtt;
+    double clock_offset;
+    int offset_samples;
+} RttEstimator;
+
+void rtt_estimator_init(RttEstimator *rtt);
+void rtt_estimator_add(RttEstimator *rtt, double sample);
+void rtt_estimator_add_ping(RttEstimator *rtt, int64_t sent_ns, int64_t peer_ns, int64_t received_ns);
+void rtt_estimator_stats(const RttEstimator *rtt, RttStats *out_stats);
+void rtt_estimator_log_stats(const RttEstimator *rtt, const char *name);
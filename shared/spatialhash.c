@@ -0,0 +1,208 @@
+#include "spatialhash.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int spatial_hash_cell(const SpatialHash *hash, game_pos_t pos)
+{
+    // Floored to whole units first so the cell only depends on the integer part in either mode
+    const int cell_units = hash->cell_units;
+#if GAME_FIXED_POINT
+    int units = pos >> 16;
+#else
+    int units = (int)floorf(pos);
+#endif
+    return units >= 0 ? units / cell_units : -((cell_units - 1 - units) / cell_units);
+}
+
+static uint32_t spatial_hash_bucket(const SpatialHash *hash, int cell_x, int cell_y)
+{
+    return (((uint32_t)cell_x * 73856093u) ^ ((uint32_t)cell_y * 19349663u)) & hash->bucket_mask;
+}
+
+spatial_dist2_t spatial_hash_dist2(game_pos_t ax, game_pos_t ay, game_pos_t bx, game_pos_t by)
+{
+    spatial_dist2_t dx = (spatial_dist2_t)ax - (spatial_dist2_t)bx;
+    spatial_dist2_t dy = (spatial_dist2_t)ay - (spatial_dist2_t)by;
+    return dx * dx + dy * dy;
+}
+
+static bool spatial_hash_near(game_pos_t ax, game_pos_t ay, game_pos_t bx, game_pos_t by, spatial_dist2_t reach)
+{
+    // Whether b is within reach of a on both axes, what sharing a 3x3 block of cells promises
+    // Far apart 16.16 positions would overflow the squared distance so check this first
+    spatial_dist2_t dx = (spatial_dist2_t)ax - (spatial_dist2_t)bx;
+    spatial_dist2_t dy = (spatial_dist2_t)ay - (spatial_dist2_t)by;
+    return dx <= reach && dx >= -reach && dy <= reach && dy >= -reach;
+}
+
+int spatial_hash_init(SpatialHash *hash, int capacity)
+{
+    memset(hash, 0, sizeof(*hash));
+    return spatial_hash_reserve(hash, capacity);
+}
+
+void spatial_hash_free(SpatialHash *hash)
+{
+    free(hash->bucket_start);
+    free(hash->added);
+    free(hash->bodies);
+    memset(hash, 0, sizeof(*hash));
+}
+
+int spatial_hash_reserve(SpatialHash *hash, int capacity)
+{
+    // Room for the bucket table of a build of capacity bodies, see spatial_hash_end()
+    if (hash->cell_units == 0) hash->cell_units = (int)(2 * PLAYER_RADIUS / GAME_POS_ONE);
+    if (capacity <= hash->capacity) return 0;
+    uint32_t bucket_count = 16;
+    while (bucket_count < 2u * (uint32_t)capacity) bucket_count *= 2;
+
+    free(hash->bucket_start);
+    free(hash->added);
+    free(hash->bodies);
+    hash->bucket_start = malloc((bucket_count + 1) * sizeof(uint32_t));
+    hash->added = malloc(capacity * sizeof(SpatialBody));
+    hash->bodies = malloc(capacity * sizeof(SpatialBody));
+    if (hash->bucket_start == NULL || hash->added == NULL || hash->bodies == NULL)
+    {
+        perror("malloc()");
+        spatial_hash_free(hash);
+        return 1;
+    }
+    hash->capacity = capacity;
+    hash->bucket_mask = bucket_count - 1;
+    hash->count = 0;
+    return 0;
+}
+
+void spatial_hash_begin(SpatialHash *hash)
+{
+    hash->count = 0;
+}
+
+void spatial_hash_add(SpatialHash *hash, int id, game_pos_t x, game_pos_t y)
+{
+    // Cells are only worked out once it is known there are enough bodies to need them
+    SpatialBody *body = &hash->added[hash->count++];
+    body->id = id;
+    body->x = x;
+    body->y = y;
+}
+
+void spatial_hash_end(SpatialHash *hash)
+{
+    hash->scan = hash->count <= SPATIAL_HASH_SCAN_MAX;
+    if (hash->scan) return;
+    for (int i = 0; i < hash->count; ++i)
+    {
+        hash->added[i].cell_x = spatial_hash_cell(hash, hash->added[i].x);
+        hash->added[i].cell_y = spatial_hash_cell(hash, hash->added[i].y);
+    }
+
+    // At least twice as many buckets as bodies keeps unrelated cells sharing a bucket rare
+    // Sized from this builds bodies rather than the room reserved, so clearing and summing the
+    // table costs what is there and not the largest capacity the hash has ever held
+    uint32_t bucket_count = 16;
+    while (bucket_count < 2u * (uint32_t)hash->count) bucket_count *= 2;
+    hash->bucket_mask = bucket_count - 1;
+
+    // Counting sort the added bodies by bucket, bucket_start[b + 1] ends up as the end of b
+    memset(hash->bucket_start, 0, (bucket_count + 1) * sizeof(uint32_t));
+    for (int i = 0; i < hash->count; ++i)
+    {
+        hash->bucket_start[spatial_hash_bucket(hash, hash->added[i].cell_x, hash->added[i].cell_y) + 1]++;
+    }
+    for (uint32_t b = 0; b < bucket_count; ++b) hash->bucket_start[b + 1] += hash->bucket_start[b];
+
+    // Filled using the starts as cursors which leaves each at its end, shift them back after
+    for (int i = 0; i < hash->count; ++i)
+    {
+        uint32_t bucket = spatial_hash_bucket(hash, hash->added[i].cell_x, hash->added[i].cell_y);
+        hash->bodies[hash->bucket_start[bucket]++] = hash->added[i];
+    }
+    memmove(&hash->bucket_start[1], &hash->bucket_start[0], bucket_count * sizeof(uint32_t));
+    hash->bucket_start[0] = 0;
+}
+
+int spatial_hash_query(const SpatialHash *hash, game_pos_t x, game_pos_t y, game_pos_t radius, int *out_ids)
+{
+    // Every body within radius of the position, in no particular order
+    // Walks the cells covering the square around the circle so any cell size works
+    const spatial_dist2_t radius2 = (spatial_dist2_t)radius * (spatial_dist2_t)radius;
+    int found = 0;
+    if (hash->scan)
+    {
+        for (int i = 0; i < hash->count; ++i)
+        {
+            const SpatialBody *body = &hash->added[i];
+            if (spatial_hash_near(x, y, body->x, body->y, radius) && spatial_hash_dist2(x, y, body->x, body->y) <= radius2) out_ids[found++] = body->id;
+        }
+        return found;
+    }
+
+    int min_x = spatial_hash_cell(hash, x - radius), max_x = spatial_hash_cell(hash, x + radius);
+    int min_y = spatial_hash_cell(hash, y - radius), max_y = spatial_hash_cell(hash, y + radius);
+
+    for (int cell_y = min_y; cell_y <= max_y; ++cell_y)
+    {
+        for (int cell_x = min_x; cell_x <= max_x; ++cell_x)
+        {
+            uint32_t bucket = spatial_hash_bucket(hash, cell_x, cell_y);
+            for (uint32_t i = hash->bucket_start[bucket]; i < hash->bucket_start[bucket + 1]; ++i)
+            {
+                const SpatialBody *body = &hash->bodies[i];
+                if (body->cell_x != cell_x || body->cell_y != cell_y) continue;
+                if (spatial_hash_dist2(x, y, body->x, body->y) <= radius2) out_ids[found++] = body->id;
+            }
+        }
+    }
+    return found;
+}
+
+static bool spatial_hash_nearer(spatial_dist2_t to_dist2, game_pos_t from_x, game_pos_t from_y, const SpatialBody *body)
+{
+    // Whether a position to_dist2 from the body, closer than touching, is nearer than from
+    // Anything past a diameter on either axis is further than touching without squaring it
+    const spatial_dist2_t diameter = (spatial_dist2_t)(2 * PLAYER_RADIUS);
+    return !spatial_hash_near(from_x, from_y, body->x, body->y, diameter) || to_dist2 < spatial_hash_dist2(from_x, from_y, body->x, body->y);
+}
+
+bool spatial_hash_blocked(const SpatialHash *hash, int id, game_pos_t from_x, game_pos_t from_y, game_pos_t to_x, game_pos_t to_y)
+{
+    // Whether moving body id from one position to the other would push it into another body
+    // Moving away from or around a body it already overlaps is allowed so stacked players can separate
+    const spatial_dist2_t diameter = (spatial_dist2_t)(2 * PLAYER_RADIUS);
+    const spatial_dist2_t touching = diameter * diameter;
+    if (hash->scan)
+    {
+        for (int i = 0; i < hash->count; ++i)
+        {
+            const SpatialBody *body = &hash->added[i];
+            if (body->id == id || !spatial_hash_near(to_x, to_y, body->x, body->y, diameter)) continue;
+            spatial_dist2_t to_dist2 = spatial_hash_dist2(to_x, to_y, body->x, body->y);
+            if (to_dist2 < touching && spatial_hash_nearer(to_dist2, from_x, from_y, body)) return true;
+        }
+        return false;
+    }
+
+    int cell_x = spatial_hash_cell(hash, to_x);
+    int cell_y = spatial_hash_cell(hash, to_y);
+
+    for (int dy = -1; dy <= 1; ++dy)
+    {
+        for (int dx = -1; dx <= 1; ++dx)
+        {
+            uint32_t bucket = spatial_hash_bucket(hash, cell_x + dx, cell_y + dy);
+            for (uint32_t i = hash->bucket_start[bucket]; i < hash->bucket_start[bucket + 1]; ++i)
+            {
+                const SpatialBody *body = &hash->bodies[i];
+                if (body->cell_x != cell_x + dx || body->cell_y != cell_y + dy || body->id == id) continue;
+                spatial_dist2_t to_dist2 = spatial_hash_dist2(to_x, to_y, body->x, body->y);
+                if (to_dist2 < touching && spatial_hash_nearer(to_dist2, from_x, from_y, body)) return true;
+            }
+        }
+    }
+    return false;
+}
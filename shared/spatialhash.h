@@ -0,0 +1,58 @@
+#pragma once
+
+#include "gameimpl.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Uniform grid spatial hash over a snapshot of player positions, for collision broad phase
+//
+// Cells are a player diameter wide so anything touching a position is in one of the 3x3
+// cells around it. Cells hash into a power of two bucket table sized from the capacity and
+// bodies are counting sorted by bucket. It is rebuilt from the positions every frame so
+// there is no state to roll back, only the buffers are kept between frames.
+// cell_units can be set before the first build for other query sizes, 0 is the diameter
+// Up to SPATIAL_HASH_SCAN_MAX bodies are not sorted into cells at all and every query scans
+// them, finding the same bodies for less than the cells cost to work out
+
+#define SPATIAL_HASH_SCAN_MAX 32
+
+// Squared distances are exact in both modes, int64 for 16.16 fixed and double for float
+// Bodies further than the reach on either axis are skipped first as 16.16 would overflow
+#if GAME_FIXED_POINT
+typedef int64_t spatial_dist2_t;
+#else
+typedef double spatial_dist2_t;
+#endif
+
+typedef struct
+{
+    int id;
+    int cell_x;
+    int cell_y;
+    game_pos_t x;
+    game_pos_t y;
+} SpatialBody;
+
+struct SpatialHash
+{
+    int cell_units;
+    int capacity;
+    int count;
+    bool scan;
+    uint32_t bucket_mask;
+    uint32_t *bucket_start;
+    SpatialBody *added;
+    SpatialBody *bodies;
+};
+
+int spatial_hash_init(SpatialHash *hash, int capacity);
+void spatial_hash_free(SpatialHash *hash);
+int spatial_hash_reserve(SpatialHash *hash, int capacity);
+
+void spatial_hash_begin(SpatialHash *hash);
+void spatial_hash_add(SpatialHash *hash, int id, game_pos_t x, game_pos_t y);
+void spatial_hash_end(SpatialHash *hash);
+
+spatial_dist2_t spatial_hash_dist2(game_pos_t ax, game_pos_t ay, game_pos_t bx, game_pos_t by);
+int spatial_hash_query(const SpatialHash *hash, game_pos_t x, game_pos_t y, game_pos_t radius, int *out_ids);
+bool spatial_hash_blocked(const SpatialHash *hash, int id, game_pos_t from_x, game_pos_t from_y, game_pos_t to_x, game_pos_t to_y);